@@ -483,6 +483,21 @@ int cmdline_process_param(CmdlineArg *arg, CmdlineArg *nextarg,
         sscanf(value, "%s", &vterm_capture_file);
     }
 
+    if (!strcmp(p, "-capturedelta")) {
+        RETURN(2);
+
+        sscanf(value, "%d", &vterm_capture_delta);
+
+        if (vterm_capture_delta <= 0) {
+            cmdline_error(dupprintf("Putty Driver 'capturedelta' only supports positive number (screens between full screens)."));
+        }
+    }
+
+    if (!strcmp(p, "-capturescreen")) {
+        RETURN(2);
+        vTermCaptureExportScreen(value);
+    }
+
     if (!strcmp(p, "-nocapture")) {
         RETURN(1);
         vterm_nocapture = true;
@@ -517,6 +532,11 @@ int cmdline_process_param(CmdlineArg *arg, CmdlineArg *nextarg,
         sscanf(value, "%s", &vterm_script_file);
     }
 
+    if (!strcmp(p, "-dataset")) {
+        RETURN(2);
+        sscanf(value, "%s", &vterm_dataset_file);
+    }
+
     if (!strcmp(p, "-screenspeed")) {
         RETURN(2);
 
@@ -532,6 +552,36 @@ int cmdline_process_param(CmdlineArg *arg, CmdlineArg *nextarg,
         }
     }
 
+    if (!strcmp(p, "-sendmode")) {
+        RETURN(2);
+
+        if (!strcmp(value, "batch")) {
+            vterm_send_batch = true;
+            vterm_send_adaptive = false;
+        }
+        else if (!strcmp(value, "keys")) {
+            vterm_send_batch = false;
+            vterm_send_adaptive = false;
+        }
+        else if (!strcmp(value, "adaptive")) {
+            vterm_send_batch = false;
+            vterm_send_adaptive = true;
+        }
+        else {
+            cmdline_error(dupprintf("Putty Driver 'sendmode' only supports words 'batch' (whole command at once), 'keys' (one key at a time) or 'adaptive' (keys until the echo is proven, then batch)."));
+        }
+    }
+
+    if (!strcmp(p, "-screenhistory")) {
+        RETURN(2);
+
+        sscanf(value, "%d", &vterm_screen_history);
+
+        if (vterm_screen_history < 0) {
+            cmdline_error(dupprintf("Putty Driver 'screenhistory' only supports positive number (in screen rows)."));
+        }
+    }
+
     if (putty_driver == true) {
 
         if (conf_get_int(conf, CONF_protocol) == PROT_SSH) {
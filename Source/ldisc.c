@@ -307,6 +307,8 @@ void ldisc_send(Ldisc *ldisc, const void *vbuf, int len, bool interactive)
 #ifdef PuttyDriver
     if (vterm_started == true) {
 
+        vterm_events |= vTerm_Event_Input;
+
         if (parent_hwnd > 0) {
 
             HWND parent = GetWindow(parent_hwnd, GW_HWNDFIRST);
@@ -324,19 +326,24 @@ void ldisc_send(Ldisc *ldisc, const void *vbuf, int len, bool interactive)
         }
         else {
 
-            strncpy(vterm_message, vbuf, len);
+            /* A whole command or pasted line can arrive in one call, so the copy is sized to it rather than vterm_message. */
+            char *vdata = snewn(len + 1, char);
+
+            memcpy(vdata, vbuf, len);
 
-            vterm_message[len] = 0;
+            vdata[len] = 0;
 
             if (vTermLog_Execution == true) {
-                vTermWriteToLog("PuTTY ldisc_send->vTermProcessData - Before", dupprintf("%d", len), vterm_message);
+                vTermWriteToLog("PuTTY ldisc_send->vTermProcessData - Before", dupprintf("%d", len), vdata);
             }
 
-            vTermProcessData(vterm_message, len, vTerm_Command);
+            vTermProcessData(vdata, len, vTerm_Command);
 
             if (vTermLog_Execution == true) {
-                vTermWriteToLog("PuTTY ldisc_send->vTermProcessData - After", dupprintf("%d", len), vterm_message);
+                vTermWriteToLog("PuTTY ldisc_send->vTermProcessData - After", dupprintf("%d", len), vdata);
             }
+
+            sfree(vdata);
         }
     }
 #endif
@@ -862,6 +862,11 @@ extern const char *const appname;
 #define vTerm_Data 1
 #define vTerm_Command 2
 
+#define vTerm_Event_Data 1
+#define vTerm_Event_Cursor 2
+#define vTerm_Event_Timer 4
+#define vTerm_Event_Input 8
+
 #define MAX_MESSAGE_LENGTH 4096
 
 bool putty_driver;
@@ -873,6 +878,7 @@ int vterm_curs_x;
 int vterm_curs_y;
 
 char vterm_capture_file[FILENAME_MAX];
+int vterm_capture_delta;
 bool vterm_nocapture;
 
 char vterm_keycodes_file[FILENAME_MAX];
@@ -889,14 +895,25 @@ bool vterm_nolog;
 char vterm_message[MAX_MESSAGE_LENGTH];
 
 int vterm_screen_speed;
+bool vterm_send_batch;
+bool vterm_send_adaptive;
+int vterm_screen_history;
+
+unsigned long vterm_screen_gen;
+unsigned long *vterm_row_gen;
+size_t vterm_row_gen_size;
 
 bool vterm_script;
 char vterm_script_file[FILENAME_MAX];
 
+char vterm_dataset_file[FILENAME_MAX];
+
 int vterm_sessionid;
 
 bool vterm_started;
 
+int vterm_events;
+
 bool vterm_trace_on;
 
 int vTermLog_Execution;
@@ -904,6 +921,10 @@ int vTermLog_Execution;
 FILE *vTermCommands_Stream;
 FILE *vTermLog_Stream;
 FILE *vTermSessions_Stream;
+
+void vTermInitialise(long term_hwnd, Terminal *term);
+void vTermEvent(int Events, Terminal *term);
+void vTermCaptureExportScreen(char *Value);
 #endif
 /* PuttyDriver */
 
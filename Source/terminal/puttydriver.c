@@ -9,17 +9,23 @@
 #include "network.h"
 #include "terminal.h"
 
-#define DECIMAL 10
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
-#define IDM_CLRSB 0x60L
-#define IDM_COPYALL 0x170L
+#define DECIMAL 10
 
 #define MAX_BUFFER_SIZE 2048
 #define MAX_STRING_LENGTH 256
 
 #define MAX_MESSAGE_LENGTH 4096
 
-#define MAX_KEYCODES_SIZE 1024
 #define MAX_FILENAME_SIZE 1024
 
 #define MAX_SCREEN_COLS MAX_STRING_LENGTH
@@ -27,8 +33,36 @@
 
 #define MAX_RAWDATA_LEN 32768
 
+/* Substring search compares a block of candidate positions at a time, on the first and last byte of the search text. */
+#if defined(__AVX2__)
+#define VTERM_SIMD_WIDTH 32
+typedef __m256i vTermVector;
+#define vTermVectorSet(ch) _mm256_set1_epi8(ch)
+#define vTermVectorMask(vec, ptr) ((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8((vec), _mm256_loadu_si256((const __m256i*)(ptr)))))
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VTERM_SIMD_WIDTH 16
+typedef __m128i vTermVector;
+#define vTermVectorSet(ch) _mm_set1_epi8(ch)
+#define vTermVectorMask(vec, ptr) ((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8((vec), _mm_loadu_si128((const __m128i*)(ptr)))))
+#endif
+
+#ifndef IS_SPACE_CHR
+#define IS_SPACE_CHR(chr) ((chr) == 0x20 || (DIRECT_CHAR(chr) && ((chr) & 0xFF) == 0x20))
+#endif
+
 #define vTerm_Command_Max_Wait 15
 #define vTerm_Command_TimeOut 30
+#define vTerm_Echo_Verify_Commands 3
+
+/* Driver states, each with the events that can move it on. */
+#define vTerm_State_AwaitScreen 0
+#define vTerm_State_AwaitEcho 1
+#define vTerm_State_AwaitSubmit 2
+#define vTerm_State_Paused 3
+#define vTerm_State_Mismatch 4
+#define vTerm_State_Manual 5
+#define vTerm_Input_Key_Wait 50
+#define vTerm_Paste_Prefix "<paste>"
 
 #define vTerm_KeyID 0
 #define vTerm_KeyName 1
@@ -36,11 +70,24 @@
 #define vTerm_KeyHex 3
 #define vTerm_KeyANSI 4
 
+#define vTerm_Screen_Find_Max 2
+#define vTerm_Screen_Watch_Max 8
+#define vTerm_Screen_History 100
+
 #define vTerm_Sessions_Max 8
 #define vTerm_Session_Offset 14
 
 #define vTerm_Command_Elements 12
-#define vTerm_Commands_Max 250
+#define vTerm_Command_Elements_Watch 13
+#define vTerm_Command_Elements_Control 14
+
+#define vTerm_Control_Max 8
+#define vTerm_Control_Goto 1
+#define vTerm_Control_If_Screen 2
+#define vTerm_Control_Loop 3
+#define vTerm_Control_Next 4
+
+#define vTerm_Dataset_Batch 50
 
 #define vTerm_Command_Seq_pos 0
 #define vTerm_Expected_Screen_Identifier_pos 1
@@ -71,7 +118,9 @@
 
 char DBDelimiter;
 
-char String_Array[MAX_BUFFER_SIZE][MAX_STRING_LENGTH];
+char** String_Array;
+size_t* String_Array_Field_Size;
+int String_Array_Size;
 
 int CaptureScreensData;
 
@@ -79,11 +128,170 @@ int RecordForScripting;
 
 int SessionsKeyPressSync;
 
+int vTermEchoVerified;
+
 typedef struct {
     int X;
     int Y;
 } CursorPos;
 
+typedef struct {
+    char* Text;
+    size_t Size;
+    int Len;
+    int* Col;
+    size_t Col_Size;
+    int Cols;
+    bool Changed;
+    bool Populated;
+    bool Read;
+    bool Wrapped;
+    unsigned long Gen;
+} vTermScreenLine;
+
+typedef struct {
+    int Len;
+    int Cols;
+    int First;
+    int Last;
+    int Block;
+    bool Blank;
+    uint64_t Hash;
+} vTermScreenRowInfo;
+
+typedef struct {
+    int Row;
+    int Col;
+    int Rows;
+    int Cols;
+} vTermScreenWatchRect;
+
+typedef struct {
+    vTermScreenWatchRect Rect[vTerm_Screen_Watch_Max];
+    int Count;
+} vTermScreenWatch;
+
+/* A jump taken when its command has been processed; Left counts down the passes a loop has remaining. */
+typedef struct {
+    int Type;
+    char* Label;
+    char* Text;
+    int Target;
+    int Count;
+    int Left;
+} vTermControl;
+
+/* One script command, compiled at load: the text fields are interned, positions and numbers are parsed once. */
+typedef struct {
+    char* Field[vTerm_Command_Elements];
+    char* Send;
+    bool Paste;
+    CursorPos Identifier_At;
+    CursorPos Prompt_At;
+    CursorPos Cursor_At;
+    int Send_Pause;
+    int Timeout;
+    long Script_DB_ID;
+    vTermScreenWatch Watch;
+    char* Label;
+    vTermControl Control[vTerm_Control_Max];
+    int Control_Count;
+} vTermCommand;
+
+/* Compiled script image, '<script>.pdc': the header, then the key codes, key index, commands and their strings, all addressed by offset. */
+#define vTerm_Image_Magic "PDRVIMG"
+#define vTerm_Image_Version 3
+#define vTerm_Image_Suffix ".pdc"
+
+typedef struct {
+    int64_t Mtime;
+    int64_t Size;
+    uint64_t Hash;
+} vTermImageSource;
+
+typedef struct {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t Size;
+    uint32_t Command_Record;
+    vTermImageSource Script;
+    vTermImageSource Keys;
+    uint32_t Keys_File;
+    int32_t Key_Count;
+    uint32_t Key_Off;
+    int32_t Key_Names_Size;
+    uint32_t Key_Names_Off;
+    int32_t Key_States_Count;
+    uint32_t Key_States_Off;
+    int32_t Command_Count;
+    uint32_t Command_Off;
+} vTermImageHeader;
+
+typedef struct {
+    int32_t Type;
+    uint32_t Label;
+    uint32_t Text;
+    int32_t Target;
+    int32_t Count;
+} vTermImageControl;
+
+typedef struct {
+    uint32_t Field[vTerm_Command_Elements];
+    uint32_t Send;
+    int32_t Paste;
+    CursorPos Identifier_At;
+    CursorPos Prompt_At;
+    CursorPos Cursor_At;
+    int32_t Send_Pause;
+    int32_t Timeout;
+    int64_t Script_DB_ID;
+    vTermScreenWatch Watch;
+    uint32_t Label;
+    int32_t Control_Count;
+    vTermImageControl Control[vTerm_Control_Max];
+} vTermImageCommand;
+
+typedef struct {
+    char Text[MAX_STRING_LENGTH];
+    int* Col;
+    unsigned long* Row_Gen;
+} vTermScreenFind;
+
+typedef struct {
+    unsigned char Ch;
+    int Child;
+    int Sibling;
+    int Fail;
+    int Output;
+    int Output_Link;
+} vTermMatchState;
+
+typedef struct {
+    char* Text;
+    int Len;
+    int First;
+    int Last;
+} vTermMatchPattern;
+
+typedef struct {
+    char* Field[vTerm_KeyANSI + 1];
+} vTermKeyCode;
+
+typedef struct {
+    unsigned char Ch;
+    int Child;
+    int Sibling;
+    int Key;
+} vTermKeyState;
+
+typedef struct {
+    int* Pattern;
+    int* Col;
+    int Count;
+    size_t Size;
+    unsigned long Gen;
+} vTermMatchRow;
+
 typedef struct {
     bool Command_Auto;
     long Command_Script_DB_ID;
@@ -95,16 +303,27 @@ typedef struct {
     char Command_Mismatch_Pos_Actual[MAX_STRING_LENGTH];
     char Command_Mismatch_Pos_Expected[MAX_STRING_LENGTH];
     char Command_Mismatch_Type[MAX_STRING_LENGTH];
-    char Command_Processed[MAX_BUFFER_SIZE];
+    char* Command_Processed;
+    size_t Command_Processed_Size;
     int Command_Processed_Len;
-    char Command_Processed_ASCII[MAX_BUFFER_SIZE];
+    char* Command_Processed_ASCII;
+    size_t Command_Processed_ASCII_Size;
     bool Command_Processed_Logging;
-    char Command_Processed_Manual_Input[MAX_BUFFER_SIZE];
+    char* Command_Processed_Manual_Input;
+    size_t Command_Processed_Manual_Input_Size;
     char Command_Processed_Submit_Key[MAX_STRING_LENGTH];
     int Command_Processed_Submit_Key_Len;
     bool Command_Processing;
     bool Command_Processing_Finished;
     bool Command_Processing_Started;
+    int Echo_Matched;
+    int Echo_State;
+    unsigned long Input_At;
+    int Input_ASCII_Len;
+    int Input_Len;
+    char Input_Pending[MAX_STRING_LENGTH];
+    int Input_Pending_Len;
+    int Input_State;
     char Command_Prompt[MAX_STRING_LENGTH];
     int Command_Prompt_Len;
     char Command_Prompt_Pos[MAX_STRING_LENGTH];
@@ -121,8 +340,12 @@ typedef struct {
     char Command_Screen_Identifier_Pos[MAX_STRING_LENGTH];
     int Command_Screen_Identifier_Pos_X;
     int Command_Screen_Identifier_Pos_Y;
-    time_t Command_Send_At;
-    char Command_Send[MAX_STRING_LENGTH];
+    unsigned long Command_Send_At;
+    unsigned long Command_Send_Gen;
+    char* Command_Send;
+    size_t Command_Send_Size;
+    bool Command_Paste;
+    int Command_Pass;
     int Command_Send_Len;
     int Command_Send_Buffer_Len;
     char Command_Send_Expected_Cursor[MAX_STRING_LENGTH];
@@ -130,25 +353,43 @@ typedef struct {
     int Command_Send_Expected_Cursor_Y;
     int Command_Send_Pause;
     int Command_Send_Pos;
-    char Command_Sent[MAX_STRING_LENGTH];
+    int Command_Timeout;
+    char* Command_Sent;
+    size_t Command_Sent_Size;
     int Command_Sent_Len;
     char Command_Sent_Cursor_Pos[MAX_STRING_LENGTH];
     int Command_Sent_Cursor_X;
     int Command_Sent_Cursor_Y;
     bool Command_Submit_Key;
     bool Command_Wait;
-    time_t Command_Wait_Until;
-    char Commands_Input[MAX_RAWDATA_LEN];
-    char Commands_Processed[MAX_RAWDATA_LEN];
+    unsigned long Command_Wait_Until;
+    bool Command_Deadline;
+    char* Commands_Input;
+    size_t Commands_Input_Size;
+    char* Commands_Processed;
+    size_t Commands_Processed_Size;
     int Controller_Updated_Seq;
     long Hwnd;
     time_t Message_At;
     long Pid;
     int Row;
-    time_t Row_Updated_At;
-    char Screen[MAX_SCREEN_ROWS * MAX_SCREEN_COLS];
-    char Screen_Array[MAX_SCREEN_ROWS][MAX_SCREEN_COLS];
+    unsigned long Row_Updated_At;
+    char* Screen;
+    unsigned long Screen_Gen;
+    size_t Screen_Size;
+    char** Screen_Array;
+    char** Screen_Array_Block;
+    int** Screen_Array_Block_Cell;
+    size_t* Screen_Array_Block_Cell_Size;
+    size_t* Screen_Array_Block_Size;
+    unsigned long* Screen_Array_Gen;
+    vTermScreenRowInfo* Screen_Array_Info;
+    int Screen_Array_Last;
     int Screen_Array_Rows;
+    int Screen_Array_Size;
+    int* Screen_Array_Wrap;
+    int Screen_Array_Wrap_Cols;
+    int Screen_Array_Wrap_Rows;
     char Screen_Capture[MAX_STRING_LENGTH];
     int Screen_Capture_Command_Seq_From;
     int Screen_Capture_Offset;
@@ -163,35 +404,74 @@ typedef struct {
     int Screen_Len;
     int Screen_Lines;
     bool Screen_Get;
-    char Screen_New[MAX_RAWDATA_LEN];
+    char* Screen_New;
+    char** Screen_New_Array;
+    unsigned long* Screen_New_Array_Gen;
+    vTermScreenRowInfo* Screen_New_Array_Info;
+    int Screen_New_Array_Last;
+    unsigned long Screen_New_Array_Gen_Last;
+    int* Screen_New_Array_Line;
+    int Screen_New_Array_Rows;
+    int Screen_New_Array_Rows_Max;
     int Screen_New_Len;
     int Screen_New_Rows;
+    size_t Screen_New_Size;
     int Screen_Ptr;
+    char* Screen_Spare;
+    size_t Screen_Spare_Size;
     char Screen_Raw[MAX_RAWDATA_LEN];
     char Screen_Raw_ASCII[MAX_RAWDATA_LEN];
+    char* Screen_View;
+    int Screen_View_Len;
+    size_t Screen_View_Size;
     long Screen_Command_Session_DB_ID_From;
     long Screen_Command_Session_DB_ID_To;
     int Screen_Command_Seq_From;
     int Screen_Command_Seq_To;
+    long Screen_Dataset_Row;
     int Screen_Requested_Seq;
+    bool Timer_Pending;
+    unsigned long Timer_Next;
     int Screen_Rows_Y;
     int Session_ID;
     char Session_Name[MAX_STRING_LENGTH];
     char SessionTimeStamp[MAX_STRING_LENGTH];
+    int State;
     char Submit_Key[MAX_STRING_LENGTH];
     int Submit_Key_Len;
     char Submit_Key_ANSI[MAX_STRING_LENGTH];
     char Submit_Key_Send[MAX_STRING_LENGTH];
     char Submit_Key_Value[MAX_STRING_LENGTH];
+    Terminal* Term;
 } vTerminal;
 
 vTerminal vTerm;
 
 char vTermSessionID[MAX_STRING_LENGTH];
 
-char vTermKeyCodes[MAX_KEYCODES_SIZE][vTerm_KeyANSI + 1][MAX_STRING_LENGTH];
+vTermKeyCode* vTermKeyCodes;
+size_t vTermKeyCodes_Size;
+int vTermKeyCodes_Count;
 
-char vTermCommands[301][13][MAX_STRING_LENGTH];
+int* vTermKeyNames;
+int vTermKeyNames_Size;
+
+vTermKeyState* vTermKeyStates;
+size_t vTermKeyStates_Size;
+int vTermKeyStates_Count;
+
+vTermCommand* vTermCommands;
+size_t vTermCommands_Size;
+bool vTermCommands_Timeout;
+int vTermCommands_Count;
+
+char** vTermStrings;
+int vTermStrings_Size;
+int vTermStrings_Count;
+
+char* vTermImageBuild;
+size_t vTermImageBuild_Size;
+size_t vTermImageBuild_Len;
 
 int vTermCommands_File;
 int vTermLog_File;
@@ -206,7 +486,75 @@ FILE *vTermLog_Stream;
 FILE *vTermCapture_Stream;
 FILE* vTermCaptureInputs_Stream;
 
+FILE* vTermDataset_Stream;
+char* vTermDataset_Row;
+long vTermDataset_Row_Num;
+
+char** vTermDataset_Columns;
+int vTermDataset_Columns_Count;
+
+char** vTermDataset_Values;
+size_t vTermDataset_Values_Size;
+int vTermDataset_Values_Count;
+
+char* vTermDataset_Bound;
+size_t vTermDataset_Bound_Size;
+
+vTermScreenLine* vTermScreenLines;
+size_t vTermScreenLines_Size;
+int vTermScreenLines_Cols;
+int vTermScreenLines_Rows;
+unsigned long vTermScreenLines_Gen;
+
+char* vTermScreenRow_Text;
+size_t vTermScreenRow_Text_Size;
+int* vTermScreenRow_Cell;
+size_t vTermScreenRow_Cell_Size;
+
+int* vTermEcho_Fail;
+size_t vTermEcho_Fail_Size;
+int vTermEcho_Fail_Len;
+
+char* vTermCapture_Text;
+size_t vTermCapture_Text_Size;
+int* vTermCapture_Line;
+size_t vTermCapture_Line_Size;
+int vTermCapture_Lines;
+char* vTermCapture_New_Text;
+size_t vTermCapture_New_Text_Size;
+int* vTermCapture_New_Line;
+size_t vTermCapture_New_Line_Size;
+int vTermCapture_Screens;
+
+vTermScreenLine vTermWatchLine;
+int* vTermWatchCells;
+size_t vTermWatchCells_Size;
+
+vTermScreenLine* vTermScrollback;
+int vTermScrollback_Size;
+int vTermScrollback_Head;
+int vTermScrollback_Count;
+unsigned long vTermScrollback_Total;
+unsigned long vTermScrollback_Mark;
+
+vTermScreenFind vTermScreenFinds[vTerm_Screen_Find_Max];
+int vTermScreenFinds_Next;
+
+vTermMatchState* vTermMatchStates;
+size_t vTermMatchStates_Size;
+int vTermMatchStates_Count;
+int vTermMatchRoot[256];
+
+vTermMatchPattern* vTermMatchPatterns;
+size_t vTermMatchPatterns_Size;
+int vTermMatchPatterns_Count;
+
+vTermMatchRow* vTermMatchRows;
+unsigned long vTermMatch_Screen_Gen;
+
 void vTermSetCommand();
+void vTermScreenUpdated(char* PuttyData, int DataLength);
+void vTermSetCommandProcessed();
 
 int datetest()
 {
@@ -261,85 +609,149 @@ bool file_exists(const char* filename) {
     return (stat(filename, &buffer) == 0);
 }
 
-int instr(char* base, char* str, int startIndex) {
+#ifdef VTERM_SIMD_WIDTH
+static int vTermBitFirst(unsigned int mask) {
+
+#if defined(_MSC_VER)
+    unsigned long bit;
+
+    _BitScanForward(&bit, mask);
 
-    int result;
-    int baselen = strlen(base);
+    return (int)bit;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static int vTermBitLast(unsigned int mask) {
+
+#if defined(_MSC_VER)
+    unsigned long bit;
+
+    _BitScanReverse(&bit, mask);
+
+    return (int)bit;
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+#endif
+
+int vTermMemFind(const char* base, int base_len, const char* str, int str_len, int start) {
+
+    int last;
+    int pos;
 
-    // str should not longer than base.
-    if (strlen(str) > baselen || startIndex > baselen) {
-        result = -1;
+    if (start < 0) {
+        start = 0;
     }
-    else {
 
-        if (startIndex < 0) {
-            startIndex = 0;
-        }
+    if (start > base_len) {
+        return -1;
+    }
+
+    if (str_len <= 0) {
+        return start;
+    }
+
+    /* Last position the search text could start at. */
+    last = base_len - str_len;
+
+    pos = start;
 
-        char* pos = strstr(base + startIndex, str);
+#ifdef VTERM_SIMD_WIDTH
+    if (pos + VTERM_SIMD_WIDTH - 1 <= last) {
 
-        if (pos == NULL) {
-            result = -1;
+        vTermVector l_first = vTermVectorSet(str[0]);
+        vTermVector l_last = vTermVectorSet(str[str_len - 1]);
+
+        unsigned int mask;
+
+        for (; pos + VTERM_SIMD_WIDTH - 1 <= last; pos += VTERM_SIMD_WIDTH) {
+
+            mask = vTermVectorMask(l_first, base + pos) & vTermVectorMask(l_last, base + pos + str_len - 1);
+
+            while (mask != 0) {
+
+                int bit = vTermBitFirst(mask);
+
+                if (memcmp(base + pos + bit, str, str_len) == 0) {
+                    return pos + bit;
+                }
+
+                mask = mask & (mask - 1);
+            }
         }
-        else {
-            result = pos - base;
+    }
+#endif
+
+    for (; pos <= last; pos++) {
+
+        if (base[pos] == str[0] && memcmp(base + pos, str, str_len) == 0) {
+            return pos;
         }
     }
-    return result;
+
+    return -1;
 }
 
-int instrrev(const char* base, const char* str) {
+int vTermMemFindLast(const char* base, int base_len, const char* str, int str_len) {
 
-    int result;
+    int pos;
 
-    // str should not be longer than base.
-    if (strlen(str) > strlen(base)) {
-        result = -1;
+    if (str_len <= 0) {
+        return base_len;
     }
-    else {
 
-        int start = 0;
+    /* Scan backwards from the last position the search text could start at. */
+    pos = base_len - str_len;
 
-        int endinit = strlen(base) - strlen(str);
+#ifdef VTERM_SIMD_WIDTH
+    if (pos - VTERM_SIMD_WIDTH + 1 >= 0) {
 
-        int end = endinit;
-        int endtmp = endinit;
+        vTermVector l_first = vTermVectorSet(str[0]);
+        vTermVector l_last = vTermVectorSet(str[str_len - 1]);
 
-        while (start != end) {
+        unsigned int mask;
 
-            start = instr(base, str, start);
-            end = instr(base, str, end);
+        for (; pos - VTERM_SIMD_WIDTH + 1 >= 0; pos -= VTERM_SIMD_WIDTH) {
 
-            // Not found from start.
-            if (start == -1) {
-                end = -1; // then break;
-            }
-            else if (end == -1) {
-                /* Found from start
-                   but not found from end
-                   move end to middle. */
-                if (endtmp == (start + 1)) {
-                    end = start; // then break;
-                }
-                else {
-                    end = endtmp - (endtmp - start) / 2;
-                    if (end <= start) {
-                        end = start + 1;
-                    }
-                    endtmp = end;
+            int block = pos - VTERM_SIMD_WIDTH + 1;
+
+            mask = vTermVectorMask(l_first, base + block) & vTermVectorMask(l_last, base + block + str_len - 1);
+
+            while (mask != 0) {
+
+                int bit = vTermBitLast(mask);
+
+                if (memcmp(base + block + bit, str, str_len) == 0) {
+                    return block + bit;
                 }
+
+                mask = mask & ~(1u << bit);
             }
-            else {
-                /* Found from both start and end
-                   move start to end and
-                   move end to base - strlen(str). */
-                start = end;
-                end = endinit;
-            }
         }
-        result = start;
     }
-    return result;
+#endif
+
+    for (; pos >= 0; pos--) {
+
+        if (base[pos] == str[0] && memcmp(base + pos, str, str_len) == 0) {
+            return pos;
+        }
+    }
+
+    return -1;
+}
+
+int instr(char* base, char* str, int startIndex) {
+
+    return vTermMemFind(base, strlen(base), str, strlen(str), startIndex);
+}
+
+int instrrev(const char* base, const char* str) {
+
+    return vTermMemFindLast(base, strlen(base), str, strlen(str));
 }
 
 bool beginswith(const char* str, const char* match, bool ignorecase) {
@@ -451,12 +863,60 @@ bool isnumeric(const char* str) {
     return has_digits;
 }
 
-void dosleep(int seconds)
-{
-    clock_t goal = (seconds * 1000) + clock();
+bool vTermTickReached(unsigned long Tick) {
+
+    return (long)(GETTICKCOUNT() - Tick) >= 0;
+}
+
+/* Send pause in milliseconds: "2" or "0.5" are seconds, "250ms" is milliseconds. */
+int vTermPauseMs(char* Pause) {
+
+    char l_num[MAX_STRING_LENGTH];
+
+    int l_len = strlen(Pause);
+
+    if (l_len > 2 && l_len < MAX_STRING_LENGTH && strcmp(&Pause[l_len - 2], "ms") == 0) {
+
+        strncpy(l_num, Pause, l_len - 2);
+        l_num[l_len - 2] = '\0';
+
+        return isnumeric(l_num) ? atoi(l_num) : -1;
+    }
+
+    return isnumeric(Pause) ? (int)(atof(Pause) * TICKSPERSEC) : -1;
+}
+
+/* The send pause field of the output records stays whole seconds, a sub-second pause rounded up so it still shows. */
+char* vTermPauseField() {
+
+    if (vTerm.Command_Send_Pause <= 0) {
+        return "";
+    }
+
+    return dupprintf("%d", (vTerm.Command_Send_Pause + TICKSPERSEC - 1) / TICKSPERSEC);
+}
+
+/* Only raises the event; the main loop runs it once PuTTY's callbacks are done. */
+void vTermTimer(void* ctx, unsigned long now) {
+
+    if (vTerm.Timer_Pending == true && now == vTerm.Timer_Next) {
+        vTerm.Timer_Pending = false;
+    }
+
+    vterm_events |= vTerm_Event_Timer;
+}
 
-    while (goal > clock())
-        Sleep(1);
+void vTermTimerSchedule(unsigned long Tick) {
+
+    long l_ticks = (long)(Tick - GETTICKCOUNT());
+
+    if (vTerm.Timer_Pending == true && (long)(vTerm.Timer_Next - Tick) <= 0) {
+        return;
+    }
+
+    vTerm.Timer_Next = schedule_timer(l_ticks > 0 ? (int)l_ticks : 1, vTermTimer, &vTerm);
+
+    vTerm.Timer_Pending = true;
 }
 
 void append_char(char* str, char ch, int max_len) {
@@ -496,6 +956,48 @@ void append_string(char* str, char* append, int max_len) {
     }
 }
 
+/* Appends to a growable record buffer, which holds however much Send text the command has. */
+void vTermRecordString(char** Record, size_t* Record_Size, char* append) {
+
+    size_t len = strlen(*Record);
+
+    sgrowarray(*Record, *Record_Size, len + strlen(append));
+
+    strcpy(*Record + len, append);
+}
+
+void vTermRecordChar(char** Record, size_t* Record_Size, char ch) {
+
+    char l_chr[2] = { ch, '\0' };
+
+    vTermRecordString(Record, Record_Size, l_chr);
+}
+
+/* Only when the script gives a command its own timeout, that command's timeout in milliseconds as a trailing field. */
+void vTermRecordTimeout(char** Record, size_t* Record_Size) {
+
+    if (vTermCommands_Timeout != true) {
+        return;
+    }
+
+    if (vTerm.Command_Seq <= vTerm.Command_Seq_Max) {
+        vTermRecordString(Record, Record_Size, dupprintf("%d", vTerm.Command_Timeout));
+    }
+
+    vTermRecordChar(Record, Record_Size, DBDelimiter);
+}
+
+/* With -dataset only, the row the command's placeholders were bound to, so results can be matched to their input rows; other runs keep the record layout unchanged. */
+void vTermRecordDatasetRow(char** Record, size_t* Record_Size) {
+
+    if (vTermDataset_Columns_Count <= 0) {
+        return;
+    }
+
+    vTermRecordString(Record, Record_Size, dupprintf("%ld", vTermDataset_Row_Num));
+    vTermRecordChar(Record, Record_Size, DBDelimiter);
+}
+
 char* string_replacechar(char* str, const char* old, const char* new) {
 
     int len = strlen(str);
@@ -510,20 +1012,132 @@ char* string_replacechar(char* str, const char* old, const char* new) {
     return str;
 }
 
-int string_split(const char* input, const char delimiter, const int array_size, const int field_size, const bool ascii_only) {
+int vTermUtf8Len( const char* Text, int Len) {
+
+    unsigned char ch = (unsigned char)Text[0];
+
+    int bytes;
+    int i;
+
+    /* Length of the UTF-8 sequence at Text, or 0 if it is not valid UTF-8. */
+    if (ch < 0x80)
+        return 1;
+    else if (ch >= 0xC2 && ch <= 0xDF)
+        bytes = 2;
+    else if (ch >= 0xE0 && ch <= 0xEF)
+        bytes = 3;
+    else if (ch >= 0xF0 && ch <= 0xF4)
+        bytes = 4;
+    else
+        return 0;
+
+    if (bytes > Len) return 0;
+
+    for (i = 1; i < bytes; i++) {
+
+        if (((unsigned char)Text[i] & 0xC0) != 0x80) return 0;
+    }
+
+    return bytes;
+}
+
+int vTermUtf8Encode( unsigned long uc, char* Text) {
+
+    if (uc < 0x80) {
+
+        Text[0] = (char)uc;
+
+        return 1;
+    }
+    else if (uc < 0x800) {
+
+        Text[0] = (char)(0xC0 | (uc >> 6));
+        Text[1] = (char)(0x80 | (uc & 0x3F));
+
+        return 2;
+    }
+    else if (uc < 0x10000) {
+
+        Text[0] = (char)(0xE0 | (uc >> 12));
+        Text[1] = (char)(0x80 | ((uc >> 6) & 0x3F));
+        Text[2] = (char)(0x80 | (uc & 0x3F));
+
+        return 3;
+    }
+
+    Text[0] = (char)(0xF0 | ((uc >> 18) & 0x07));
+    Text[1] = (char)(0x80 | ((uc >> 12) & 0x3F));
+    Text[2] = (char)(0x80 | ((uc >> 6) & 0x3F));
+    Text[3] = (char)(0x80 | (uc & 0x3F));
+
+    return 4;
+}
+
+int vTermUtf8Col( const char* Text, int Byte) {
+
+    int col = 0;
+    int i;
+
+    /* Screen column of a byte offset, counting each character once. */
+    for (i = 0; i < Byte; i++) {
+
+        if (((unsigned char)Text[i] & 0xC0) != 0x80) col++;
+    }
+
+    return col;
+}
+
+int vTermUtf8Byte( const char* Text, int Len, int Col) {
+
+    int i;
+
+    /* Byte offset of a screen column, or Col itself past the end of the text (as for plain ASCII). */
+    for (i = 0; i < Len && Col > 0; i++) {
+
+        if (i + 1 >= Len || ((unsigned char)Text[i + 1] & 0xC0) != 0x80) Col--;
+    }
+
+    return i + Col;
+}
+
+int string_split(const char* input, const char delimiter, const int array_size, const int field_size, const bool utf8_only) {
 
     int i = 0;
     int j = 0;
+    int k;
+    int len;
+    int utf8_len;
     
     int ctr;
 
-    if (strlen(input) <= 0) return 0;
+    len = strlen(input);
+
+    if (len <= 0) return 0;
 
     ctr = 0;
 
-    memset(String_Array, 0, (MAX_BUFFER_SIZE * MAX_STRING_LENGTH));
+    if (String_Array_Size < array_size + 1) {
+
+        String_Array = sresize(String_Array, array_size + 1, char*);
+        String_Array_Field_Size = sresize(String_Array_Field_Size, array_size + 1, size_t);
+
+        for (i = String_Array_Size; i < array_size + 1; i++) {
+
+            String_Array[i] = NULL;
+            String_Array_Field_Size[i] = 0;
+
+            sgrowarray(String_Array[i], String_Array_Field_Size[i], MAX_STRING_LENGTH - 1);
+        }
+
+        String_Array_Size = array_size + 1;
+    }
+
+    /* Each field grows to fit its text, up to field_size. */
+    for (i = 0; i < array_size + 1; i++) {
+        String_Array[i][0] = '\0';
+    }
 
-    for (i = 0; i < strlen(input); i++) {
+    for (i = 0; i < len; i++) {
 
         if (input[i] == delimiter || input[i] == '\0') {
 
@@ -548,13 +1162,26 @@ int string_split(const char* input, const char delimiter, const int array_size,
 
         }
         else {
-            
-            if (isascii(input[i])) {
+
+            sgrowarray(String_Array[ctr], String_Array_Field_Size[ctr], j + 4);
+
+            utf8_len = vTermUtf8Len(input + i, len - i);
+
+            if (utf8_len > 1 && j + utf8_len - 1 < field_size) {
+
+                /* Multi-byte UTF-8 characters (box drawing, accented text) are kept whole. */
+                for (k = 0; k < utf8_len - 1; k++) {
+                    String_Array[ctr][j++] = input[i++];
+                }
+
+                String_Array[ctr][j] = input[i];
+            }
+            else if (isascii(input[i])) {
                 String_Array[ctr][j] = input[i];
             }
-            else if (ascii_only == true) {
+            else if (utf8_only == true) {
 
-                MessageBox(NULL, dupprintf("Fatal Error : Non-ASCII character '%c' found at position '%d' of input string '%s'.\n\nNon-ASCII characters are not supported - exiting program.", input[i], i, input), "Putty Driver", MB_ICONERROR | MB_OK);
+                MessageBox(NULL, dupprintf("Fatal Error : Invalid UTF-8 character '%c' found at position '%d' of input string '%s'.\n\nOnly ASCII and UTF-8 characters are supported - exiting program.", input[i], i, input), "Putty Driver", MB_ICONERROR | MB_OK);
 
                 exit(EXIT_FAILURE);
 
@@ -574,6 +1201,8 @@ int string_split(const char* input, const char delimiter, const int array_size,
         }
     }
 
+    String_Array[ctr][j] = '\0';
+
     return ctr;
 }
 
@@ -857,1432 +1486,4993 @@ void vTermWriteToLog( char* FunctionName, char* Actual_Data, char* Expected_Data
     }
 }
 
-char* vTermSessionGetValue( int Command_Pos, int Command_Seq) {
+uint64_t vTermScreenRowHash( const char* Text, int Len) {
 
-    if (Command_Seq <= 0) {
-        Command_Seq = vTerm.Command_Seq;
-    }
+    uint64_t hash = 14695981039346656037ULL;
 
-    if (Command_Pos >= vTerm_DBRecord_Session_Cmd_ID_pos) {
-        Command_Pos = Command_Pos + vTerm.Screen_Capture_Offset;
+    int i;
+
+    /* 64-bit FNV-1a. */
+    for (i = 0; i < Len; i++) {
+
+        hash = hash ^ (unsigned char)Text[i];
+
+        hash = hash * 1099511628211ULL;
     }
 
-    return vTermCommands[Command_Seq][Command_Pos];
+    return hash;
 }
 
-void ReadKeyCodesFromFile() {
+char* vTermIntern(const char* Text) {
 
-    char cwdpath[MAX_FILENAME_SIZE];
+    char** l_old;
 
-    char input[MAX_BUFFER_SIZE];
+    int l_old_size;
+    int l_slot;
 
-    char keycode[MAX_STRING_LENGTH];
+    /* Keep the table at most half full. */
+    if (vTermStrings_Count * 2 >= vTermStrings_Size) {
 
-    FILE* stream;
+        l_old = vTermStrings;
+        l_old_size = vTermStrings_Size;
 
-    int num = 0;
-    int seq = 0;
+        vTermStrings_Size = (l_old_size > 0 ? l_old_size * 2 : 256);
+        vTermStrings = snewn(vTermStrings_Size, char*);
 
-    if (strlen(vterm_keycodes_file) == 0) {
+        memset(vTermStrings, 0, vTermStrings_Size * sizeof(char*));
 
-        getcwd(cwdpath, MAX_FILENAME_SIZE);
+        for (int i = 0; i < l_old_size; i++) {
 
-        snprintf(vterm_keycodes_file, sizeof(vterm_keycodes_file), "%s\\Scripts\\KeyCodes_Default.txt", cwdpath);
-    }
+            if (l_old[i] != NULL) {
 
-    if (file_exists(vterm_keycodes_file) != true) {
+                l_slot = (int)(vTermScreenRowHash(l_old[i], strlen(l_old[i])) & (vTermStrings_Size - 1));
 
-        MessageBox(NULL, dupprintf("Fatal Error : Key Codes File '%s' does not exist - exiting program.", vterm_keycodes_file), "Putty Driver", MB_ICONERROR | MB_OK);
+                while (vTermStrings[l_slot] != NULL) l_slot = (l_slot + 1) & (vTermStrings_Size - 1);
 
-        exit(EXIT_FAILURE);
+                vTermStrings[l_slot] = l_old[i];
+            }
+        }
+
+        sfree(l_old);
     }
 
-    stream = fopen(vterm_keycodes_file, "r");
+    l_slot = (int)(vTermScreenRowHash(Text, strlen(Text)) & (vTermStrings_Size - 1));
 
-    if (stream == NULL) {
+    while (vTermStrings[l_slot] != NULL) {
 
-        MessageBox(NULL, dupprintf("Fatal Error : Cannot open Key Codes File '%s' - exiting program.", vterm_keycodes_file), "Putty Driver", MB_ICONERROR | MB_OK);
-        
-        exit(EXIT_FAILURE);
+        if (strcmp(vTermStrings[l_slot], Text) == 0) {
+            return vTermStrings[l_slot];
+        }
+
+        l_slot = (l_slot + 1) & (vTermStrings_Size - 1);
     }
 
-    while (fgets(input, sizeof(input), stream)) {
+    vTermStrings[l_slot] = dupstr(Text);
 
-        num = string_split(input, '|', vTerm_KeyANSI + 1, MAX_STRING_LENGTH, false);
+    vTermStrings_Count++;
 
-        if (num <= 0) {
+    return vTermStrings[l_slot];
+}
 
-            MessageBox(NULL, dupprintf("Fatal Error : Data mismatch reading Key Codes File File '%s' line %d - exiting program.", cwdpath, seq), "Putty Driver", MB_ICONERROR | MB_OK);
+/* 'Y,X' with either part left out; Any_Text takes any non-'*' part as a number, otherwise it must be numeric. */
+void vTermCommandParseXY(const char* Text, CursorPos* Pos, bool Any_Text) {
 
-            fclose(stream);
-
-            exit(EXIT_FAILURE);
-
-        }
-        else {
-
-            strcpy(vTermKeyCodes[seq][vTerm_KeyID], ifnull(String_Array[vTerm_KeyID], "0"));
-            strcpy(vTermKeyCodes[seq][vTerm_KeyName], ifnull(String_Array[vTerm_KeyName], "0"));
-            strcpy(vTermKeyCodes[seq][vTerm_KeyValue], ifnull(String_Array[vTerm_KeyValue], "0"));
-            strcpy(vTermKeyCodes[seq][vTerm_KeyHex], ifnull(String_Array[vTerm_KeyHex], "0"));
-
-            if (strlen(String_Array[vTerm_KeyANSI]) >= 5) {
+    char l_xy[MAX_STRING_LENGTH];
+    char* l_exp_xy;
 
-                if (strncmp(String_Array[vTerm_KeyANSI], "<esc>", 5) == 0) {
+    Pos->Y = -1;
+    Pos->X = -1;
 
-                    memset(keycode, 0, sizeof(keycode));
+    strncpy(l_xy, Text, MAX_STRING_LENGTH - 1);
+    l_xy[MAX_STRING_LENGTH - 1] = '\0';
 
-                    strncpy(keycode, String_Array[vTerm_KeyANSI] + 5, strlen(String_Array[vTerm_KeyANSI]) - 5);
+    l_exp_xy = strtok(l_xy, ",");
 
-                    sprintf(vTermKeyCodes[seq][vTerm_KeyANSI], "%c%s", 27, keycode);
+    if (l_exp_xy != NULL) {
 
-                }
-                else
-                    strcpy(vTermKeyCodes[seq][vTerm_KeyANSI], String_Array[vTerm_KeyANSI]);
+        if (Any_Text ? strcmp(l_exp_xy, "*") != 0 : isnumeric(l_exp_xy) == true) Pos->Y = atoi(l_exp_xy);
 
-            }
-            else {
-                strcpy(vTermKeyCodes[seq][vTerm_KeyANSI], String_Array[vTerm_KeyANSI]);
-            }
+        l_exp_xy = strtok(NULL, ",");
 
-            seq++;
+        if (l_exp_xy != NULL) {
+            if (Any_Text ? strcmp(l_exp_xy, "*") != 0 : isnumeric(l_exp_xy) == true) Pos->X = atoi(l_exp_xy);
         }
     }
-
-    fclose(stream);
 }
 
-void ReadCommandsFromFile() {
+void vTermCommandCompile(vTermCommand* Command) {
 
-    char cwdpath[MAX_FILENAME_SIZE];
+    char l_pause[MAX_STRING_LENGTH];
 
-    char input[MAX_BUFFER_SIZE];
+    char* l_send = Command->Field[vTerm_Command_Send_pos];
+    char* l_num;
+    char* l_timeout;
 
-    FILE* stream;
+    vTermCommandParseXY(Command->Field[vTerm_Expected_Screen_Identifier_At_pos], &Command->Identifier_At, true);
+    vTermCommandParseXY(Command->Field[vTerm_Expected_Command_Prompt_At_pos], &Command->Prompt_At, false);
+    vTermCommandParseXY(Command->Field[vTerm_Expected_Input_Cursor_At_pos], &Command->Cursor_At, false);
 
-    int num = 0;
+    /* '<paste>' in front of the text sends it as one terminal paste rather than key by key. */
+    Command->Paste = (strncmp(l_send, vTerm_Paste_Prefix, strlen(vTerm_Paste_Prefix)) == 0);
 
-    if (strlen(trim(vterm_script_file)) == 0) {
-        return;
-    }
+    Command->Send = (Command->Paste == true ? vTermIntern(l_send + strlen(vTerm_Paste_Prefix)) : l_send);
 
-    if ((file_exists(vterm_script_file) != true) && (instrrev(vterm_script_file, "\\") < 0)) {
+    /* 'pause/timeout', either part in the pause format; no timeout means vTerm_Command_TimeOut. */
+    strncpy(l_pause, Command->Field[vTerm_Command_Send_Pause_pos], MAX_STRING_LENGTH - 1);
+    l_pause[MAX_STRING_LENGTH - 1] = '\0';
 
-        getcwd(cwdpath, MAX_FILENAME_SIZE);
+    l_timeout = strchr(l_pause, '/');
 
-        snprintf(vterm_script_file, sizeof(cwdpath), "%s\\Scripts\\%s", cwdpath, dupstr(vterm_script_file));
+    if (l_timeout != NULL) {
+        *l_timeout++ = '\0';
     }
 
-    if (file_exists(vterm_script_file) != true) {
+    Command->Send_Pause = vTermPauseMs(strlen(l_pause) == 0 ? "0" : l_pause);
 
-        MessageBox(NULL, dupprintf("Fatal Error : Script Commands File '%s' does not exist - exiting program.", vterm_script_file), "Putty Driver", MB_ICONERROR | MB_OK);
+    Command->Timeout = (l_timeout == NULL || strlen(l_timeout) == 0 ? -1 : vTermPauseMs(l_timeout));
 
-        exit(EXIT_FAILURE);
-    }
+    if (Command->Timeout > 0) vTermCommands_Timeout = true;
 
-    stream = fopen(vterm_script_file, "r");
+    l_num = Command->Field[vTerm_DBRecord_Script_Cmd_ID_pos];
 
-    if (stream == NULL) {
+    Command->Script_DB_ID = (strlen(l_num) == 0 ? 0 : (isnumeric(l_num) == true ? atol(l_num) : -1));
+}
 
-        MessageBox(NULL, dupprintf("Fatal Error : Cannot open Script Commands File '%s' - exiting program.", vterm_script_file), "Putty Driver", MB_ICONERROR | MB_OK);
+/* Records are added on demand, so neither the script nor recorded input has a length limit. */
+vTermCommand* vTermCommandAt(int Command_Seq) {
 
-        exit(EXIT_FAILURE);
+    if (Command_Seq < 0) {
+        Command_Seq = 0;
     }
-    
-    vTerm.Command_Seq_Max = 0;
-    
-    while (fgets(input, sizeof(input), stream)) {
-
-        if (strlen(input) > vTerm_Command_Elements) {
-
-            num = string_split(input, '|', vTerm_Command_Elements, MAX_STRING_LENGTH, true);
 
-            if (num != vTerm_Command_Elements) {
-
-                MessageBox(NULL, dupprintf("Fatal Error : Data mismatch reading Script Commands File '%s' line %d - exiting program.", vterm_script_file, vTerm.Command_Seq_Max + 1), "Putty Driver", MB_ICONERROR | MB_OK);
+    if (Command_Seq >= vTermCommands_Count) {
 
-                fclose(stream);
+        sgrowarray(vTermCommands, vTermCommands_Size, Command_Seq);
 
-                exit(EXIT_FAILURE);
+        for (int i = vTermCommands_Count; i <= Command_Seq; i++) {
 
+            for (int j = 0; j < vTerm_Command_Elements; j++) {
+                vTermCommands[i].Field[j] = vTermIntern("");
             }
-            else {
 
-                vTerm.Command_Seq = atoi(ifnull(String_Array[vTerm_Command_Seq_pos], "0"));
+            vTermCommands[i].Watch.Count = 0;
 
-                if (vTerm.Command_Seq <= 0) {
-                    // Script default params - ignore.
-                }
-                else {
-                    
-                    vTerm.Command_Seq_Max++;
-                
-                    if (vTerm.Command_Seq != vTerm.Command_Seq_Max) {
+            vTermCommands[i].Label = vTermIntern("");
+            vTermCommands[i].Control_Count = 0;
 
-                        MessageBox(NULL, dupprintf("Fatal Error : 'Command_Seq' data mismatch reading Script Commands File '%s' line %d - exiting program.", vterm_script_file, vTerm.Command_Seq_Max + 1), "Putty Driver", MB_ICONERROR | MB_OK);
+            vTermCommandCompile(&vTermCommands[i]);
+        }
 
-                        fclose(stream);
+        vTermCommands_Count = Command_Seq + 1;
+    }
 
-                        exit(EXIT_FAILURE);
+    return &vTermCommands[Command_Seq];
+}
 
-                    }
-                    
-                    strcpy(vTermCommands[vTerm.Command_Seq_Max][vTerm_Command_Seq_pos], ifnull(String_Array[vTerm_Command_Seq_pos], "0"));
-                    strcpy(vTermCommands[vTerm.Command_Seq_Max][vTerm_Expected_Screen_Identifier_pos], ifnull(String_Array[vTerm_Expected_Screen_Identifier_pos], ""));
-                    strcpy(vTermCommands[vTerm.Command_Seq_Max][vTerm_Expected_Screen_Identifier_At_pos], ifnull(String_Array[vTerm_Expected_Screen_Identifier_At_pos], ""));
-                    strcpy(vTermCommands[vTerm.Command_Seq_Max][vTerm_Screen_Capture_OnOff_pos], ifnull(String_Array[vTerm_Screen_Capture_OnOff_pos], ""));
-                    strcpy(vTermCommands[vTerm.Command_Seq_Max][vTerm_Expected_Command_Prompt_pos], ifnull(String_Array[vTerm_Expected_Command_Prompt_pos], ""));
-                    strcpy(vTermCommands[vTerm.Command_Seq_Max][vTerm_Expected_Command_Prompt_At_pos], ifnull(String_Array[vTerm_Expected_Command_Prompt_At_pos], ""));
-                    strcpy(vTermCommands[vTerm.Command_Seq_Max][vTerm_Expected_Input_Cursor_At_pos], ifnull(String_Array[vTerm_Expected_Input_Cursor_At_pos], ""));
-                    strcpy(vTermCommands[vTerm.Command_Seq_Max][vTerm_Command_Send_pos], ifnull(String_Array[vTerm_Command_Send_pos], ""));
-                    strcpy(vTermCommands[vTerm.Command_Seq_Max][vTerm_Command_Input_Hidden_pos], ifnull(String_Array[vTerm_Command_Input_Hidden_pos], ""));
-                    strcpy(vTermCommands[vTerm.Command_Seq_Max][vTerm_Command_Submit_Key_pos], ifnull(String_Array[vTerm_Command_Submit_Key_pos], ""));
-                    strcpy(vTermCommands[vTerm.Command_Seq_Max][vTerm_Command_Send_Pause_pos], ifnull(String_Array[vTerm_Command_Send_Pause_pos], ""));
-                    strcpy(vTermCommands[vTerm.Command_Seq_Max][vTerm_DBRecord_Script_Cmd_ID_pos], ifnull(String_Array[vTerm_DBRecord_Script_Cmd_ID_pos], "0"));
+char* vTermSessionGetValue( int Command_Pos, int Command_Seq) {
 
-                    vTermSetCommand();
+    if (Command_Seq <= 0) {
+        Command_Seq = vTerm.Command_Seq;
+    }
 
-                } 
-            }
-        }
+    if (Command_Pos >= vTerm_DBRecord_Session_Cmd_ID_pos) {
+        Command_Pos = Command_Pos + vTerm.Screen_Capture_Offset;
     }
 
-    fclose(stream);
+    return vTermCommandAt(Command_Seq)->Field[Command_Pos];
 }
 
-void vTermOpenSessionFiles() {
-
-    char cwdpath[MAX_FILENAME_SIZE];
+int vTermMatchGoto(int state, unsigned char ch) {
 
-    char capture_file[MAX_FILENAME_SIZE];
-    char capture_script_file[MAX_FILENAME_SIZE];
+    int child;
 
-    char host_name[MAX_FILENAME_SIZE];
-    char script_name[MAX_FILENAME_SIZE];
+    if (state == 0) {
+        return vTermMatchRoot[ch];
+    }
 
-    char* host;
+    for (child = vTermMatchStates[state].Child; child >= 0; child = vTermMatchStates[child].Sibling) {
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog("vTermOpenSessionFiles|Start", NULL, NULL);
+        if (vTermMatchStates[child].Ch == ch) {
+            return child;
+        }
     }
 
-    if (vterm_nocapture != true) {
+    return -1;
+}
 
-        getcwd(cwdpath, MAX_FILENAME_SIZE);
+int vTermMatchNewState(int parent, unsigned char ch) {
 
-        host = strtok(dupprintf("%s", vterm_hostname), ".");
+    int state;
 
-        if (host != NULL)
-            strcpy(host_name, host);
-        else
-            strcpy(host_name, vterm_hostname);
+    sgrowarray(vTermMatchStates, vTermMatchStates_Size, vTermMatchStates_Count);
 
-        strcpy(script_name, vTermGetFileName(vterm_script_file, false));
+    state = vTermMatchStates_Count;
 
-        if (!(vterm_nolog == true)) {
+    vTermMatchStates_Count++;
 
-            if (instrrev(vterm_log_file, "\\") < 0) {
+    vTermMatchStates[state].Ch = ch;
+    vTermMatchStates[state].Child = -1;
+    vTermMatchStates[state].Sibling = -1;
+    vTermMatchStates[state].Fail = 0;
+    vTermMatchStates[state].Output = -1;
+    vTermMatchStates[state].Output_Link = -1;
 
-                if (strlen(vterm_log_file) <= 0 ||
-                    stricmp(vterm_log_file, "yes") == 0 ||
-                    stricmp(vterm_log_file, "on") == 0) {
+    if (parent == 0) {
+        vTermMatchRoot[ch] = state;
+    }
+    else if (parent > 0) {
 
-                    if (vterm_sessionid > 0) {
-                        strcpy(vterm_log_file, dupprintf("%s_%d_%s", host_name, vterm_sessionid, script_name, false));
-                    }
-                    else if (vterm_script == true) {
+        vTermMatchStates[state].Sibling = vTermMatchStates[parent].Child;
 
-                        if (instr(vterm_script_file, host_name, true) >= 0)
-                            strcpy(vterm_log_file, script_name);
-                        else
-                            strcpy(vterm_log_file, dupprintf("%s_%s", host_name, script_name));
+        vTermMatchStates[parent].Child = state;
+    }
 
-                    }
-                    else
-                        strcpy(vterm_log_file, dupprintf("%s_new_script", host_name));
-                }
-            }
+    return state;
+}
 
-            if (strlen(vterm_log_file) > 0) {
+int vTermMatchAddPattern(char* Text) {
 
-                if (instrrev(vterm_log_file, "\\") < 0) {
-                    strcpy(vterm_log_file, dupstr(vTermSetFileName("Logs", dupstr(vterm_log_file), "log", true, false)));
-                }
+    int i;
+    int next;
+    int state;
 
-                if (file_exists(vterm_log_file) == true) {
+    if (strlen(Text) <= 0) {
+        return -1;
+    }
 
-                    MessageBox(NULL, dupprintf("Fatal Error : Session screens capture file '%s' already exists - exiting program.", vterm_log_file), "Putty Driver", MB_ICONERROR | MB_OK);
+    if (vTermMatchStates_Count == 0) {
 
-                    exit(EXIT_FAILURE);
+        memset(vTermMatchRoot, 0, sizeof(vTermMatchRoot));
 
-                }
-            }
+        vTermMatchNewState(-1, 0);
+    }
 
-            vTermInitialiseLogs();
-        }
+    state = 0;
 
-        if (instrrev(vterm_capture_file, "\\") < 0) {
+    for (i = 0; Text[i] != '\0'; i++) {
 
-            if (strlen(vterm_capture_file) <= 0 ||
-                stricmp(vterm_capture_file, "yes") == 0 ||
-                stricmp(vterm_capture_file, "on") == 0) {
+        next = vTermMatchGoto(state, (unsigned char)Text[i]);
 
-                if (vterm_sessionid > 0) {
-                    strcpy(vterm_capture_file, dupprintf("%s_%d_%s", host_name, vterm_sessionid, script_name));
-                }
-                else if (vterm_script == true) {
+        if (next <= 0) {
+            next = vTermMatchNewState(state, (unsigned char)Text[i]);
+        }
 
-                    if (instr(script_name, host_name, true) >= 0)
-                        strcpy(vterm_capture_file, script_name);
-                    else
-                        strcpy(vterm_capture_file, dupprintf("%s_%s", host_name, script_name));
+        state = next;
+    }
 
-                }
-                else
-                    strcpy(vterm_capture_file, dupprintf("%s_new_script", host_name));
-            }
-        }
+    if (vTermMatchStates[state].Output < 0) {
 
-        if (strlen(vterm_capture_file) > 0) {
+        sgrowarray(vTermMatchPatterns, vTermMatchPatterns_Size, vTermMatchPatterns_Count);
 
-            if (instrrev(vterm_capture_file, "\\") < 0) {
-                strcpy(vterm_capture_file, dupstr(vTermSetFileName("Capture", dupstr(vterm_capture_file), "log", true, false)));
-            }
+        vTermMatchPatterns[vTermMatchPatterns_Count].Text = dupstr(Text);
+        vTermMatchPatterns[vTermMatchPatterns_Count].Len = strlen(Text);
+        vTermMatchPatterns[vTermMatchPatterns_Count].First = -1;
+        vTermMatchPatterns[vTermMatchPatterns_Count].Last = -1;
 
-            if (file_exists(vterm_capture_file) == true) {
+        vTermMatchStates[state].Output = vTermMatchPatterns_Count;
 
-                MessageBox(NULL, dupprintf("Fatal Error : Session screens capture file '%s' already exists - exiting program.", vterm_capture_file), "Putty Driver", MB_ICONERROR | MB_OK);
+        vTermMatchPatterns_Count++;
+    }
 
-                exit(EXIT_FAILURE);
+    return vTermMatchStates[state].Output;
+}
 
-            }
+void vTermMatchBuild() {
 
-            vTermCapture_Stream = fopen(vterm_capture_file, "w");
+    int* l_queue;
 
-            if (vTermCapture_Stream == NULL) {
+    int child;
+    int head;
+    int next;
+    int state;
+    int tail;
+    int row;
 
-                MessageBox(NULL, dupprintf("Fatal Error : Session screens capture file '%s' create failed - exiting program.", vterm_capture_file), "Putty Driver", MB_ICONERROR | MB_OK);
+    if (vTermMatchStates_Count <= 0) {
+        return;
+    }
 
-                exit(EXIT_FAILURE);
+    l_queue = snewn(vTermMatchStates_Count, int);
 
-            }
-        }
+    head = 0;
+    tail = 0;
 
-        if (vterm_script != true) {
+    for (child = 0; child < 256; child++) {
 
-            strcpy(capture_script_file, vTermGetFileName(vterm_capture_file, false));
+        if (vTermMatchRoot[child] > 0) {
 
-            if (instrrev(capture_script_file, "\\") < 0) {
-                strcpy(capture_script_file, dupstr(vTermSetFileName("Capture", dupstr(capture_script_file), "inputs", false, false)));
-            }
+            vTermMatchStates[vTermMatchRoot[child]].Fail = 0;
 
-            if (file_exists(capture_script_file) == true) {
+            l_queue[tail++] = vTermMatchRoot[child];
+        }
+    }
 
-                MessageBox(NULL, dupprintf("Fatal Error : Session inputs capture file '%s' already exists - exiting program.", capture_script_file), "Putty Driver", MB_ICONERROR | MB_OK);
+    /* Breadth first, so each state's failure state is complete before its children are linked. */
+    while (head < tail) {
 
-                exit(EXIT_FAILURE);
+        state = l_queue[head++];
 
-            }
+        for (child = vTermMatchStates[state].Child; child >= 0; child = vTermMatchStates[child].Sibling) {
 
-            vTermCaptureInputs_Stream = fopen(capture_script_file, "w");
+            next = vTermMatchStates[state].Fail;
 
-            if (vTermCaptureInputs_Stream == NULL) {
+            while (vTermMatchGoto(next, vTermMatchStates[child].Ch) < 0) {
+                next = vTermMatchStates[next].Fail;
+            }
 
-                MessageBox(NULL, dupprintf("Fatal Error : Session inputs capture file '%s' create failed - exiting program.", capture_script_file), "Putty Driver", MB_ICONERROR | MB_OK);
+            next = vTermMatchGoto(next, vTermMatchStates[child].Ch);
 
-                exit(EXIT_FAILURE);
+            vTermMatchStates[child].Fail = next;
 
-            }
+            vTermMatchStates[child].Output_Link = (vTermMatchStates[next].Output >= 0 ? next : vTermMatchStates[next].Output_Link);
+
+            l_queue[tail++] = child;
         }
+    }
 
-        fprintf(vTermCapture_Stream, "<?xml version=""1.0"" encoding=""UTF-8"" standalone=""yes""?>\n");
-        fprintf(vTermCapture_Stream, "<events_log xmlns:xsi=""http://www.w3.org/2001/XMLSchema-instance"">\n");
+    sfree(l_queue);
 
-        fprintf(vTermCapture_Stream, dupprintf("<user>%s</user>\n", get_username()));
-        fprintf(vTermCapture_Stream, dupprintf("<session_id>%d</session_id>\n", vterm_sessionid));
+    vTermMatch_Screen_Gen = (unsigned long)-1;
 
-        fflush(vTermCapture_Stream);
-    }
-    
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog("vTermOpenSessionFiles|Finish", NULL, NULL);
+    for (row = 0; row < vTerm.Screen_Array_Size; row++) {
+        vTermMatchRows[row].Gen = (unsigned long)-1;
     }
 }
 
-void vTermWriteSessionToFile() {
+int vTermMatchPatternID(char* Text) {
 
-    char log_data[MAX_RAWDATA_LEN];
+    int i;
+    int state;
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog("vTermWriteSessionToFile|Start", NULL, NULL);
+    if (vTermMatchStates_Count <= 0 || Text[0] == '\0') {
+        return -1;
     }
 
-    if (vterm_nocapture != true) {
+    state = 0;
 
-        if (vTermCapture_Stream == NULL) {
+    /* An exact lookup: only real trie edges, so the root's fall-back to itself ends the walk. */
+    for (i = 0; Text[i] != '\0'; i++) {
 
-            MessageBox(NULL, dupprintf("Fatal Error : Session commands file '%s' create failed - exiting program.", vterm_capture_file), "Putty Driver", MB_ICONERROR | MB_OK);
+        state = vTermMatchGoto(state, (unsigned char)Text[i]);
 
-            exit(EXIT_FAILURE);
+        if (state <= 0) {
+            return -1;
         }
+    }
 
-        if (vTerm.Screen_Command_Seq_From <= 1) {
+    return vTermMatchStates[state].Output;
+}
 
-            fprintf(vTermCapture_Stream, dupprintf("<server_hostname>%s</server_hostname>\n", vterm_hostname));
-            fprintf(vTermCapture_Stream, dupprintf("<server_ip>%s</server_ip>\n", vterm_host_ip));
-            fprintf(vTermCapture_Stream, dupprintf("<server_conntype>%s</server_conntype>\n", vterm_host_conntype));
-            fprintf(vTermCapture_Stream, dupprintf("<server_connport>%d</server_connport>\n", vterm_host_connport));
-            fprintf(vTermCapture_Stream, dupprintf("<script>%s</script>\n", vterm_script_file));
-            /* fprintf(vTermCapture_Stream, dupprintf("<stack_space>%llu</stack_space>\n", getavailablestackspace())); */
-            fprintf(vTermCapture_Stream, dupprintf("<process_start>%s</process_start>\n", vTerm.SessionTimeStamp));
+void vTermMatchText(char* Text, int Row) {
 
-        }
+    vTermMatchRow* match;
 
-        fprintf(vTermCapture_Stream, "%s\n", vTerm.Commands_Processed);
+    int i;
+    int j;
+    int next;
+    int out;
+    int pattern;
+    int pos;
+    int state;
 
-        if (vTerm.Screen_Capture_Pending == true) {
+    state = 0;
 
-            fprintf(vTermCapture_Stream, "<commands_processed_screen>%d%c%d%c</commands_processed_screen>\n", vTerm.Screen_Capture_Command_Seq_From, DBDelimiter, vTerm.Screen_Command_Seq_To, DBDelimiter);
+    /* One pass reports every pattern, at the position (end - length + 1) it starts. */
+    for (i = 0; Text[i] != '\0'; i++) {
 
-            vTerm.Screen_Capture_Command_Seq_From = vTerm.Screen_Command_Seq_To + 1;
+        next = vTermMatchGoto(state, (unsigned char)Text[i]);
 
-            sprintf(log_data, "%s", vTerm.Screen);
+        while (next < 0) {
 
-            fprintf(vTermCapture_Stream, "<screen>\n%s\n</screen>\n", rtrim(string_replacechar(vTerm.Screen, '\r', ' ')));
+            state = vTermMatchStates[state].Fail;
+
+            next = vTermMatchGoto(state, (unsigned char)Text[i]);
         }
 
-        fflush(vTermCapture_Stream);
+        state = next;
 
-        if (vTermCaptureInputs_Stream != NULL) {
+        out = (vTermMatchStates[state].Output >= 0 ? state : vTermMatchStates[state].Output_Link);
 
-            if (vTerm.Screen_Command_Seq_From <= 1) {
-                fprintf(vTermCaptureInputs_Stream, dupprintf("0|%s|%s|%s||%s|%s|%d|||||\n", ifnull(vterm_script_file, "New Script"), string_replacechar(dupstr(vterm_hostname), '.', '_'), vterm_hostname, vterm_host_ip, vterm_host_conntype, vterm_host_connport));
-            }
+        while (out >= 0) {
 
-            fprintf(vTermCaptureInputs_Stream, "%s\n", rtrim(string_replacechar(vTerm.Commands_Input, '\r', ' ')));
+            pattern = vTermMatchStates[out].Output;
 
-            fflush(vTermCaptureInputs_Stream);
-        }
-    }
+            pos = i - vTermMatchPatterns[pattern].Len + 1;
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog("vTermWriteSessionToFile|Finish", NULL, NULL);
-    }
-}
+            if (Row < 0) {
 
-void vTermCloseSessionLogs() {
+                if (vTermMatchPatterns[pattern].First < 0) {
+                    vTermMatchPatterns[pattern].First = pos;
+                }
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog("vTermCloseSessionLogs", NULL, NULL);
-    }
+                vTermMatchPatterns[pattern].Last = pos;
+            }
+            else {
 
-    vTermSessionTimeStamp();
+                match = &vTermMatchRows[Row];
 
-    if (vTermCapture_Stream != NULL) {
+                for (j = 0; j < match->Count && match->Pattern[j] != pattern; j++);
 
-        vTermWriteSessionToFile();
+                if (j >= match->Count) {
 
-        if (vTermCaptureInputs_Stream != NULL) {
+                    sgrowarray(match->Pattern, match->Size, match->Count);
 
-            fflush(vTermCaptureInputs_Stream);
+                    match->Col = sresize(match->Col, match->Size, int);
 
-            fclose(vTermCaptureInputs_Stream);
+                    match->Pattern[match->Count] = pattern;
+                    match->Col[match->Count] = pos;
 
-            vTermCaptureInputs_Stream = NULL;
+                    match->Count++;
+                }
+            }
 
+            out = vTermMatchStates[out].Output_Link;
         }
+    }
+}
 
-        fprintf(vTermCapture_Stream, dupprintf("<process_finish>%s</process_finish>\n", vTerm.SessionTimeStamp));
-
-        fprintf(vTermCapture_Stream, "</events_log>\n");
-
-        fflush(vTermCapture_Stream);
+int vTermMatchScreen(int Pattern, bool Last) {
 
-        fclose(vTermCapture_Stream);
+    int i;
 
-        vTermCapture_Stream = NULL;
-    }
+    /* Rescan only when .Screen has changed since the last scan. */
+    if (vTermMatch_Screen_Gen != vTerm.Screen_Gen) {
 
-    if (vTermLog_Stream != NULL) {
+        for (i = 0; i < vTermMatchPatterns_Count; i++) {
 
-        if (vTerm.Command_Seq_Max > 0) {
-            fprintf(vTermLog_Stream, "%d|%s|Processed %d of %d Commands\n", vTerm.Session_ID, vTerm.SessionTimeStamp, vTerm.Screen_Command_Seq_To, vTerm.Command_Seq_Max);
-        }
-        else {
-            fprintf(vTermLog_Stream, "%d|%s|Processed %d Commands\n", vTerm.Session_ID, vTerm.SessionTimeStamp, vTerm.Screen_Command_Seq_To);
+            vTermMatchPatterns[i].First = -1;
+            vTermMatchPatterns[i].Last = -1;
         }
 
-        fclose(vTermLog_Stream);
+        vTermMatchText(vTerm.Screen, -1);
 
-        vTermLog_Stream = NULL;
+        vTermMatch_Screen_Gen = vTerm.Screen_Gen;
     }
+
+    return (Last ? vTermMatchPatterns[Pattern].Last : vTermMatchPatterns[Pattern].First);
 }
 
-void vTermSessionSetValue( char* Command_Value, int Command_Pos, int Command_Seq) {
+int vTermMatchRowCol(int Pattern, int Row) {
 
-    if (Command_Seq <= 0) {
-        Command_Seq = vTerm.Command_Seq;
-    }
+    vTermMatchRow* match = &vTermMatchRows[Row];
 
-    if (Command_Pos >= vTerm_DBRecord_Session_Cmd_ID_pos) {
-        Command_Pos = Command_Pos + vTerm.Screen_Capture_Offset;
-    }
-    else {
-        strcpy(vTermCommands[Command_Seq][Command_Pos], Command_Value);
-    }
-}
+    int i;
 
-int vTermScreenWrapAdjust( int Screen_Row) {
+    /* Rescan only rows copied into .Screen_Array since the last scan. */
+    if (match->Gen != vTerm.Screen_Array_Gen[Row]) {
 
-    int adjust;
-    int row;
+        match->Count = 0;
 
-    adjust = 0;
+        vTermMatchText(vTerm.Screen_Array[Row], Row);
 
-    row = Screen_Row;
+        match->Gen = vTerm.Screen_Array_Gen[Row];
+    }
 
-    while (row > 0) {
+    for (i = 0; i < match->Count; i++) {
 
-        if (strlen(vTerm.Screen_Array[row]) > vTerm.Screen_Columns_X) {
-            adjust = adjust + (int)(strlen(vTerm.Screen_Array[row]) / (double)vTerm.Screen_Columns_X);
+        if (match->Pattern[i] == Pattern) {
+            return match->Col[i];
         }
-
-        row = row - 1;
     }
 
-    return adjust;
+    return -1;
 }
 
-char* vTermScreenTextPosition( char* ScreenText, bool CursorPos) {
-
-    static char vTermScreenTextPositionRet[MAX_STRING_LENGTH];
+int vTermScreenFindFirst(char* ScreenText) {
 
-    int pos;
-    int row;
-    int row_adj;
+    int pattern = vTermMatchPatternID(ScreenText);
 
-    vTermScreenText_Pos_X = -1;
-    vTermScreenText_Pos_Y = -1;
+    if (pattern < 0) {
+        return instr(vTerm.Screen, ScreenText, 0);
+    }
 
-    memset(vTermScreenTextPositionRet,0, MAX_STRING_LENGTH);
+    return vTermMatchScreen(pattern, false);
+}
 
-    row = MAX_SCREEN_ROWS - 1;
+int vTermScreenFindLast(char* ScreenText) {
 
-    while (row >= 0) {
-        
-        if (strlen(trim(vTerm.Screen_Array[row])) > 0) break;
+    int pattern = vTermMatchPatternID(ScreenText);
 
-        row--;
+    if (pattern < 0) {
+        return instrrev(vTerm.Screen, ScreenText);
     }
 
-    while (row >= 0) {
+    return vTermMatchScreen(pattern, true);
+}
 
-        row_adj = vTermScreenWrapAdjust(row - 1);
+void vTermScriptFilesResolve() {
 
-        if (!CursorPos || row + row_adj == vTerm.Screen_Cursor.Y) {
+    char cwdpath[MAX_FILENAME_SIZE];
 
-            pos = instr(vTerm.Screen_Array[row], ScreenText, 0);
+    if (strlen(vterm_keycodes_file) == 0) {
 
-            if (pos >= 0) {
+        getcwd(cwdpath, MAX_FILENAME_SIZE);
 
-                sprintf(vTermScreenTextPositionRet, "%d,%d", row + row_adj, pos);
+        snprintf(vterm_keycodes_file, sizeof(vterm_keycodes_file), "%s\\Scripts\\KeyCodes_Default.txt", cwdpath);
+    }
 
-                vTermScreenText_Pos_X = pos;
-                vTermScreenText_Pos_Y = row + row_adj;
+    if (strlen(trim(vterm_dataset_file)) > 0 && (file_exists(vterm_dataset_file) != true) && (instrrev(vterm_dataset_file, "\\") < 0)) {
 
-                break;
-            }
-        }
+        getcwd(cwdpath, MAX_FILENAME_SIZE);
 
-        row--;
+        snprintf(vterm_dataset_file, sizeof(vterm_dataset_file), "%s\\Scripts\\%s", cwdpath, dupstr(vterm_dataset_file));
     }
 
-    return vTermScreenTextPositionRet;
-}
+    if (strlen(trim(vterm_script_file)) == 0) {
+        return;
+    }
 
-void vTermSessionGetScreen( int GetScreen) {
+    if ((file_exists(vterm_script_file) != true) && (instrrev(vterm_script_file, "\\") < 0)) {
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog( "vTermSessionGetScreen|Start", dupprintf("%s", GetScreen ? "true" : "false"), NULL);
+        getcwd(cwdpath, MAX_FILENAME_SIZE);
+
+        snprintf(vterm_script_file, sizeof(cwdpath), "%s\\Scripts\\%s", cwdpath, dupstr(vterm_script_file));
     }
+}
 
-    if (GetScreen == true) {
+void ReadKeyCodesFromFile() {
 
-        //vTerm.Command_Mismatch = false;
-            
-        vTerm.Screen_Get = true;
-            
-        vTerm.Screen_Requested_Seq = vTerm.Command_Seq;
+    char input[MAX_BUFFER_SIZE];
 
-        SendMessage((HWND)vTerm.Hwnd, WM_COMMAND, (WPARAM)IDM_CLRSB, (LPARAM)0L);
-        SendMessage((HWND)vTerm.Hwnd, WM_COMMAND, (WPARAM)IDM_COPYALL, (LPARAM)0L);
+    char keycode[MAX_STRING_LENGTH];
 
-    }
-    else if (vTerm.Screen_Get == true) {
+    FILE* stream;
 
-        if (vTermLog_Execution == true) {
-            vTermWriteToLog( "Waiting for vTermSessionGetScreen|", dupprintf("%d", vTerm.Hwnd), NULL);
-        }
-    }
-    else if (!(vTerm.Screen_Cursor_Prev_X == vTerm.Screen_Cursor.X && vTerm.Screen_Cursor_Prev_Y == vTerm.Screen_Cursor.Y)) {
+    int num = 0;
+    int seq = 0;
 
-        vTerm.Screen_Get = true;
-        vTerm.Screen_Requested_Seq = vTerm.Command_Seq;
+    if (file_exists(vterm_keycodes_file) != true) {
 
-        SendMessage((HWND)vTerm.Hwnd, WM_COMMAND, (WPARAM)IDM_CLRSB, (LPARAM)0L);
-        SendMessage((HWND)vTerm.Hwnd, WM_COMMAND, (WPARAM)IDM_COPYALL, (LPARAM)0L);
-    }
+        MessageBox(NULL, dupprintf("Fatal Error : Key Codes File '%s' does not exist - exiting program.", vterm_keycodes_file), "Putty Driver", MB_ICONERROR | MB_OK);
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog("vTermSessionGetScreen|Finish", dupprintf("%s", GetScreen ? "true" : "false"), NULL);
+        exit(EXIT_FAILURE);
     }
-}
 
-void vTermSubmitKey( char* CmdKey, bool AnsiSeq) {
-
-    int l_ptr;
-    char snum[5];
+    stream = fopen(vterm_keycodes_file, "r");
 
-    char tmpstr[MAX_BUFFER_SIZE];
+    if (stream == NULL) {
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog("vTermSubmitKey|Start", CmdKey, NULL);
+        MessageBox(NULL, dupprintf("Fatal Error : Cannot open Key Codes File '%s' - exiting program.", vterm_keycodes_file), "Putty Driver", MB_ICONERROR | MB_OK);
+        
+        exit(EXIT_FAILURE);
     }
 
-    vTerm.Submit_Key_ANSI[0] = '\0';
-    vTerm.Submit_Key_Send[0] = '\0';
+    while (fgets(input, sizeof(input), stream)) {
 
-    vTerm.Submit_Key_Len = 0;
+        num = string_split(input, '|', vTerm_KeyANSI + 1, MAX_STRING_LENGTH, false);
 
-    vTerm.Command_Processed_Submit_Key[0] = '\0';
+        if (num <= 0) {
 
-    vTerm.Command_Processed_Submit_Key_Len = 0;
+            MessageBox(NULL, dupprintf("Fatal Error : Data mismatch reading Key Codes File File '%s' line %d - exiting program.", vterm_keycodes_file, seq), "Putty Driver", MB_ICONERROR | MB_OK);
 
-    sprintf(tmpstr, dupprintf("%s-%d-%s-%d", CmdKey, strlen(CmdKey), trim(CmdKey), strlen(trim(CmdKey))));
+            fclose(stream);
 
-    if (strlen(CmdKey) > 0) {
+            exit(EXIT_FAILURE);
 
-        if (AnsiSeq == true) {
+        }
+        else {
 
-            l_ptr = 0;
+            sgrowarray(vTermKeyCodes, vTermKeyCodes_Size, seq);
 
-            vTerm.Command_Submit_Key = false;
+            vTermKeyCodes[seq].Field[vTerm_KeyID] = dupstr(ifnull(String_Array[vTerm_KeyID], "0"));
+            vTermKeyCodes[seq].Field[vTerm_KeyName] = dupstr(ifnull(String_Array[vTerm_KeyName], "0"));
+            vTermKeyCodes[seq].Field[vTerm_KeyValue] = dupstr(ifnull(String_Array[vTerm_KeyValue], "0"));
+            vTermKeyCodes[seq].Field[vTerm_KeyHex] = dupstr(ifnull(String_Array[vTerm_KeyHex], "0"));
 
-            while (l_ptr < MAX_KEYCODES_SIZE) {
+            if (strlen(String_Array[vTerm_KeyANSI]) >= 5) {
 
-                if ((strlen(CmdKey) == 1 && strcmp(vTermKeyCodes[l_ptr][vTerm_KeyANSI], dupprintf("%d", CmdKey[0])) == 0) || (strcmp(vTermKeyCodes[l_ptr][vTerm_KeyANSI], CmdKey) == 0)) {
+                if (strncmp(String_Array[vTerm_KeyANSI], "<esc>", 5) == 0) {
 
-                    vTerm.Command_Submit_Key = true;
+                    memset(keycode, 0, sizeof(keycode));
 
-                    strcpy(vTerm.Command_Processed_Submit_Key, vTermKeyCodes[l_ptr][vTerm_KeyName]);
+                    strncpy(keycode, String_Array[vTerm_KeyANSI] + 5, strlen(String_Array[vTerm_KeyANSI]) - 5);
 
-                    vTerm.Command_Processed_Submit_Key_Len = strlen(CmdKey);
+                    vTermKeyCodes[seq].Field[vTerm_KeyANSI] = dupprintf("%c%s", 27, keycode);
 
-                    l_ptr = 999;
                 }
+                else
+                    vTermKeyCodes[seq].Field[vTerm_KeyANSI] = dupstr(String_Array[vTerm_KeyANSI]);
 
-                l_ptr = l_ptr + 1;
+            }
+            else {
+                vTermKeyCodes[seq].Field[vTerm_KeyANSI] = dupstr(String_Array[vTerm_KeyANSI]);
             }
 
-            if (vTerm.Command_Submit_Key == true) {
+            seq++;
 
-                if (RecordForScripting == true) {
+            vTermKeyCodes_Count = seq;
+        }
+    }
 
-                    if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
+    fclose(stream);
+}
 
-                        vTermSessionSetValue( vTerm.Command_Prompt_Pos, vTerm_Command_Sent_Cursor_At_pos, vTerm.Command_Seq);
-                        vTermSessionSetValue( vTerm.Command_Processed, vTerm_Command_Send_pos, vTerm.Command_Seq);
-                        vTermSessionSetValue( vTerm.Command_Processed_Submit_Key, vTerm_Command_Submit_Key_pos, vTerm.Command_Seq);
-                    }
-                }
+bool vTermWatchParse( char* WatchText, vTermScreenWatch* Watch) {
 
-                vTerm.Command_Processed_Len = 0;
+    vTermScreenWatchRect* rect;
 
-                vTerm.Command_Processed_Manual_Input[0] = '\0';
+    char* l_rect;
 
-                vTerm.Command_Processing_Started = false;
-                vTerm.Command_Processing_Finished = true;
-            }
+    int num;
+
+    Watch->Count = 0;
+
+    if (strlen(trim(WatchText)) == 0) {
+        return true;
+    }
+
+    /* 'row,col[,rows[,cols]]' rectangles separated by ';', one row to the end of the line by default. */
+    for (l_rect = strtok(WatchText, ";"); l_rect != NULL; l_rect = strtok(NULL, ";")) {
+
+        if (Watch->Count >= vTerm_Screen_Watch_Max) {
+            return false;
         }
-        else {
 
-            strcpy(vTerm.Submit_Key_Send, CmdKey);
+        rect = &Watch->Rect[Watch->Count];
 
-            vTerm.Submit_Key_Len = strlen(CmdKey);
+        rect->Rows = 1;
+        rect->Cols = -1;
+
+        num = sscanf(l_rect, "%d,%d,%d,%d", &rect->Row, &rect->Col, &rect->Rows, &rect->Cols);
 
-            l_ptr = 0;
+        if (num < 2 || rect->Row < 0 || rect->Col < 0 || rect->Rows <= 0 || rect->Cols == 0 || rect->Cols < -1) {
+            return false;
+        }
 
-            while (l_ptr < MAX_KEYCODES_SIZE) {
+        Watch->Count++;
+    }
 
-                if (strcmp(vTermKeyCodes[l_ptr][vTerm_KeyName], CmdKey) == 0) {
+    return true;
+}
 
-                    if (isnumeric(vTermKeyCodes[l_ptr][vTerm_KeyANSI]) == true) {
+void vTermDatasetFlush() {
 
-                        vTerm.Submit_Key_Send[0] = atoi(vTermKeyCodes[l_ptr][vTerm_KeyANSI]);
-                        vTerm.Submit_Key_Send[1] = '\0';
+    if (vTermCapture_Stream != NULL) {
+        fflush(vTermCapture_Stream);
+    }
 
-                        strcpy(vTerm.Submit_Key_ANSI, vTerm.Submit_Key_Send);
-                        strcpy(vTerm.Submit_Key_Value, vTerm.Submit_Key_Send);
+    if (vTermCaptureInputs_Stream != NULL) {
+        fflush(vTermCaptureInputs_Stream);
+    }
+}
 
-                        vTerm.Submit_Key_Len = 1;
+/* Splits a CSV line in place into vTermDataset_Values; quoted fields may hold commas and doubled quotes, not line breaks. */
+void vTermDatasetSplit(char* Line) {
 
-                    }
-                    else {
+    char* l_in = Line;
+    char* l_out;
 
-                        memset(vTerm.Submit_Key_ANSI, 0, sizeof(vTerm.Submit_Key_ANSI));
+    int l_len = strlen(Line);
 
-                        strncpy(vTerm.Submit_Key_ANSI, vTermKeyCodes[l_ptr][vTerm_KeyANSI], strlen(vTermKeyCodes[l_ptr][vTerm_KeyANSI]));
-                        strncpy(vTerm.Submit_Key_Value, vTermKeyCodes[l_ptr][vTerm_KeyValue], strlen(vTermKeyCodes[l_ptr][vTerm_KeyValue]));
+    while (l_len > 0 && (Line[l_len - 1] == '\n' || Line[l_len - 1] == '\r')) Line[--l_len] = '\0';
 
-                        vTerm.Submit_Key_Len = strlen(vTerm.Submit_Key_ANSI);
-                        //vTerm.Submit_Key_Len = strlen(vTerm.Submit_Key_Value);
+    vTermDataset_Values_Count = 0;
 
-                    }
+    while (true) {
 
-                    l_ptr = 999;
+        sgrowarray(vTermDataset_Values, vTermDataset_Values_Size, vTermDataset_Values_Count);
+
+        l_out = l_in;
+
+        vTermDataset_Values[vTermDataset_Values_Count++] = l_out;
+
+        if (*l_in == '"') {
+
+            l_in++;
+
+            while (*l_in != '\0') {
+
+                if (*l_in == '"' && l_in[1] == '"') {
+
+                    *l_out++ = '"';
+
+                    l_in += 2;
                 }
+                else if (*l_in == '"') {
 
-                l_ptr = l_ptr + 1;
+                    l_in++;
+
+                    break;
+                }
+                else {
+                    *l_out++ = *l_in++;
+                }
             }
+
+            while (*l_in != ',' && *l_in != '\0') l_in++;
+        }
+        else {
+            while (*l_in != ',' && *l_in != '\0') *l_out++ = *l_in++;
         }
-    }
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog("vTermSubmitKey|Finish", CmdKey, NULL);
+        if (*l_in == '\0') {
+
+            *l_out = '\0';
+
+            break;
+        }
+
+        *l_out = '\0';
+
+        l_in++;
     }
 }
 
-char* vTermGetCommand( int commandpos, int isnumber) {
+/* Reads the next row, one line at a time, so a dataset of any length is never held whole. */
+bool vTermDatasetRead() {
 
-    if (isnumber && strlen(vTermCommands[vTerm.Command_Seq][commandpos]) == 0) {
-        return "0";
-    }
-    else {
-        return vTermCommands[vTerm.Command_Seq][commandpos];
+    if (vTermDataset_Row != NULL) {
+        sfree(vTermDataset_Row);
     }
 
-}
+    /* Any length of row, as a '##column##' value may be a multi-KB Send; the values point into it until the next read. */
+    vTermDataset_Row = fgetline(vTermDataset_Stream);
 
-void vTermSetCommand() {
+    return (vTermDataset_Row != NULL);
+}
 
-    char* l_exp_xy;
+bool vTermDatasetNext() {
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog( "vTermSetCommand|Start", NULL, NULL);
+    if (vTermDataset_Stream == NULL) {
+        return false;
     }
 
-    if ((vTerm.Command_Seq > 1) && (vTerm.Command_Mismatch == true)) {
+    while (vTermDatasetRead()) {
+
+        if (strspn(vTermDataset_Row, " \t\r\n") == strlen(vTermDataset_Row)) {
+            continue;
+        }
+
+        vTermDatasetSplit(vTermDataset_Row);
+
+        vTermDataset_Row_Num++;
+
+        /* Results are flushed once per batch of rows rather than after every command. */
+        if (vTermDataset_Row_Num % vTerm_Dataset_Batch == 0) {
+            vTermDatasetFlush();
+        }
 
         if (vTermLog_Execution == true) {
-            vTermWriteToLog("vTermSetCommand|Return", "Command Mismatch = True", NULL);
+            vTermWriteToLog("vTermDatasetNext|Row", dupprintf("%ld", vTermDataset_Row_Num), vterm_dataset_file);
         }
 
-        return;
+        return true;
     }
 
-    vTerm.Command_Auto = false;
-
-    strcpy(vTerm.Command_Screen_Identifier, vTermGetCommand(vTerm_Expected_Screen_Identifier_pos, false));
-    strcpy(vTerm.Command_Screen_Identifier_Pos, vTermGetCommand(vTerm_Expected_Screen_Identifier_At_pos, false));
+    fclose(vTermDataset_Stream);
 
-    strcpy(vTerm.Command_Prompt_Expected, vTermGetCommand(vTerm_Expected_Command_Prompt_pos, false));
-    strcpy(vTerm.Command_Prompt_Expected_Pos, vTermGetCommand(vTerm_Expected_Command_Prompt_At_pos, false));
+    vTermDataset_Stream = NULL;
+    vTermDataset_Values_Count = 0;
 
-    //MessageBox(NULL, dupprintf("%d %d %s %s", vTerm.Command_Seq, vTerm_Expected_Command_Prompt_pos, vTermCommands[vTerm.Command_Seq][vTerm_Expected_Command_Prompt_pos], vTerm.Command_Prompt_Expected), "Putty Driver", MB_ICONERROR | MB_OK);
+    vTermDatasetFlush();
 
-    strcpy(vTerm.Command_Send_Expected_Cursor, vTermGetCommand(vTerm_Expected_Input_Cursor_At_pos, false));
+    return false;
+}
 
-    strcpy(vTerm.Command_Send, vTermGetCommand( vTerm_Command_Send_pos, false));
+void vTermDatasetOpen() {
 
-    if (isnumeric(vTermGetCommand(vTerm_Command_Send_Pause_pos, true)) == true) vTerm.Command_Send_Pause = atoi(vTermGetCommand(vTerm_Command_Send_Pause_pos, true));
+    int i;
+    int j;
 
-    if (isnumeric(vTermGetCommand(vTerm_DBRecord_Script_Cmd_ID_pos, true)) == true) vTerm.Command_Script_DB_ID = atol(vTermGetCommand(vTerm_DBRecord_Script_Cmd_ID_pos, true));
+    if (strlen(trim(vterm_dataset_file)) == 0) {
+        return;
+    }
 
-    strcpy(vTerm.Command_Input_Hidden, vTermGetCommand(vTerm_Command_Input_Hidden_pos, false));
+    vTermDataset_Stream = fopen(vterm_dataset_file, "r");
 
-    strcpy(vTerm.Screen_Capture, vTermGetCommand(vTerm_Screen_Capture_OnOff_pos, false));
+    if (vTermDataset_Stream == NULL) {
 
-    strcpy(vTerm.Submit_Key, vTermGetCommand(vTerm_Command_Submit_Key_pos, false));
+        MessageBox(NULL, dupprintf("Fatal Error : Cannot open Dataset File '%s' - exiting program.", vterm_dataset_file), "Putty Driver", MB_ICONERROR | MB_OK);
 
-    vTerm.Command_Screen_Identifier_Len = strlen(vTerm.Command_Screen_Identifier);
+        exit(EXIT_FAILURE);
+    }
 
-    vTerm.Command_Screen_Identifier_Pos_Y = -1;
-    vTerm.Command_Screen_Identifier_Pos_X = -1;
+    /* The first line names the columns bound by '##column##'. */
+    if (vTermDatasetRead() != true) {
 
-    l_exp_xy = strtok(dupprintf("%s", vTerm.Command_Screen_Identifier_Pos), ",");
+        MessageBox(NULL, dupprintf("Fatal Error : Dataset File '%s' has no column header line - exiting program.", vterm_dataset_file), "Putty Driver", MB_ICONERROR | MB_OK);
 
-    if (l_exp_xy != NULL) {
+        exit(EXIT_FAILURE);
+    }
 
-        if (strcmp(l_exp_xy, "*") != 0) vTerm.Command_Screen_Identifier_Pos_Y = atoi(l_exp_xy);
+    vTermDatasetSplit(vTermDataset_Row);
 
-        l_exp_xy = strtok(NULL, ",");
+    vTermDataset_Columns = snewn(vTermDataset_Values_Count, char*);
+    vTermDataset_Columns_Count = vTermDataset_Values_Count;
 
-        if (l_exp_xy != NULL) {
-            if (strcmp(l_exp_xy, "*") != 0) vTerm.Command_Screen_Identifier_Pos_X = atoi(l_exp_xy);
-        }
+    for (i = 0; i < vTermDataset_Columns_Count; i++) {
+        vTermDataset_Columns[i] = dupstr(trim(vTermDataset_Values[i]));
     }
 
-    vTerm.Command_Prompt_OK[0] = '\0';
+    vTermDataset_Row_Num = 0;
 
-    vTerm.Command_Prompt_Expected_Len = strlen(vTerm.Command_Prompt_Expected);
+    if (vTermDatasetNext() != true) {
 
-    vTerm.Command_Prompt_Expected_Pos_Y = -1;
-    vTerm.Command_Prompt_Expected_Pos_X = -1;
+        MessageBox(NULL, dupprintf("Fatal Error : Dataset File '%s' has no rows - exiting program.", vterm_dataset_file), "Putty Driver", MB_ICONERROR | MB_OK);
 
-    l_exp_xy = strtok(dupprintf("%s", vTerm.Command_Prompt_Expected_Pos), ",");
+        exit(EXIT_FAILURE);
+    }
 
-    if (l_exp_xy != NULL) {
+    /* Without a NEXT control the script only ever sees the first row. */
+    for (i = 1; i <= vTerm.Command_Seq_Max; i++) {
 
-        if (isnumeric(l_exp_xy) == true) vTerm.Command_Prompt_Expected_Pos_Y = atoi(l_exp_xy);
+        for (j = 0; j < vTermCommandAt(i)->Control_Count && vTermCommandAt(i)->Control[j].Type != vTerm_Control_Next; j++);
 
-        l_exp_xy = strtok(NULL, ",");
+        if (j < vTermCommandAt(i)->Control_Count) break;
+    }
 
-        if (l_exp_xy != NULL) {
-            if (isnumeric(l_exp_xy) == true) vTerm.Command_Prompt_Expected_Pos_X = atoi(l_exp_xy);
-        }
+    if (i > vTerm.Command_Seq_Max) {
+        vTermWriteToLog("vTermDatasetOpen|Warning : No command has a NEXT control, only the first dataset row will be used", vterm_dataset_file, NULL);
     }
+}
 
-    l_exp_xy = strtok(dupprintf("%s",vTerm.Command_Send_Expected_Cursor), ",");
+void vTermDatasetAppend(int* Len, const char* Text, int Add) {
 
-    vTerm.Command_Send_Expected_Cursor_Y = -1;
-    vTerm.Command_Send_Expected_Cursor_X = -1;
+    sgrowarray(vTermDataset_Bound, vTermDataset_Bound_Size, *Len + Add);
 
-    if (l_exp_xy != NULL) {
+    memcpy(vTermDataset_Bound + *Len, Text, Add);
 
-        if (isnumeric(l_exp_xy) == true) vTerm.Command_Send_Expected_Cursor_Y = atoi(l_exp_xy);
+    *Len += Add;
 
-        l_exp_xy = strtok(NULL, ",");
+    vTermDataset_Bound[*Len] = '\0';
+}
 
-        if (l_exp_xy != NULL) {
-            if (isnumeric(l_exp_xy) == true) vTerm.Command_Send_Expected_Cursor_X = atoi(l_exp_xy);
-        }
-    }
+/* Replaces '##column##' with the current row's value in .._Bound, returning its length or -1 if there is nothing to replace; other '##...##' text, such as '##private##', is kept. */
+int vTermDatasetBound(const char* Text) {
 
-    vTerm.Screen_Identifier[0] = '\0';
-    vTerm.Screen_Identifier_Pos[0] = '\0';
+    const char* l_from = Text;
+    const char* l_start;
+    const char* l_end;
+    char* l_value;
 
-    vTerm.Command_Prompt[0] = '\0';
-    vTerm.Command_Prompt_Len = 0;
-    vTerm.Command_Prompt_Pos[0] = '\0';
-    vTerm.Command_Prompt_OK[0] = '\0';
+    int l_len = 0;
+    int l_col;
 
-    vTerm.Command_Sent[0] = '\0';
-    vTerm.Command_Sent_Len = 0;
-    vTerm.Command_Sent_Cursor_Pos[0] = '\0';
+    if (vTermDataset_Values_Count <= 0 || strstr(Text, "##") == NULL) {
+        return -1;
+    }
 
-    vTerm.Command_Mismatch = false;
-    vTerm.Command_Mismatch_Type[0] = '\0';
-    vTerm.Command_Mismatch_Pos_Expected[0] = '\0';
-    vTerm.Command_Mismatch_Pos_Actual[0] = '\0';
+    while ((l_start = strstr(l_from, "##")) != NULL && (l_end = strstr(l_start + 2, "##")) != NULL) {
 
-    vTerm.Command_Processed[0] = '\0';
-    vTerm.Command_Processed_Len = 0;
-    vTerm.Command_Processed_Submit_Key[0] = '\0';
+        for (l_col = 0; l_col < vTermDataset_Columns_Count; l_col++) {
 
-    vTerm.Command_Processing = false;
-    vTerm.Command_Processing_Started = false;
-    vTerm.Command_Processing_Finished = false;
+            if (strlen(vTermDataset_Columns[l_col]) == (size_t)(l_end - l_start - 2) && strncmp(vTermDataset_Columns[l_col], l_start + 2, l_end - l_start - 2) == 0) break;
+        }
 
-    if (vTerm.Command_Send_Pause <= 0) {
-        vTerm.Command_Wait_Until = time(NULL) - 999;
-    }
-    else {
-        vTerm.Command_Wait_Until = time(NULL) + vTerm.Command_Send_Pause;
-    }
+        if (l_col >= vTermDataset_Columns_Count) {
+            l_start += 2;
+        }
 
-    vTerm.Command_Send_At = time(NULL);
+        vTermDatasetAppend(&l_len, l_from, (int)(l_start - l_from));
 
-    vTerm.Command_Submit_Key = false;
+        if (l_col >= vTermDataset_Columns_Count) {
 
-    vTerm.Command_Send_Len = strlen(vTerm.Command_Send);
-    vTerm.Command_Send_Buffer_Len = vTerm.Command_Send_Len;
+            l_from = l_start;
 
-    vTerm.Command_Send_Pos = 0;
+            continue;
+        }
 
-    vTerm.Submit_Key_ANSI[0] = '\0';
-    vTerm.Submit_Key_Send[0] = '\0';
-    vTerm.Submit_Key_Len = 0;
+        l_value = (l_col < vTermDataset_Values_Count ? vTermDataset_Values[l_col] : "");
 
-    vTermSubmitKey( vTerm.Submit_Key, false);
+        vTermDatasetAppend(&l_len, l_value, strlen(l_value));
 
-    if (vTerm.Command_Prompt_Expected_Len + vTerm.Command_Send_Buffer_Len + vTerm.Submit_Key_Len > 0) {
-        vTerm.Command_Auto = true;
-    }
-    else {
-        vTerm.Command_Auto = false;
+        l_from = l_end + 2;
     }
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog( "vTermSetCommand|Finish", NULL, NULL);
-    }
+    vTermDatasetAppend(&l_len, l_from, strlen(l_from));
+
+    return l_len;
 }
 
-void vTermCommandMismatch( char* MismatchType, char* Actual_Pos, char* Expected_Pos) {
+/* The bound text, cut to fit a fixed size field. */
+void vTermDatasetBind(char* Text, int Size) {
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog(dupprintf("vTermCommandMismatch - %s|Start", MismatchType), Actual_Pos, Expected_Pos);
-    }
+    int l_len;
 
-    vTermSessionSetValue( vTerm.Command_Prompt_OK, 0, 0);
+    l_len = vTermDatasetBound(Text);
 
-    if (vTerm.Screen_Requested_Seq < vTerm.Command_Seq) {
-        vTermSessionGetScreen( false);
+    if (l_len < 0) {
+        return;
     }
-    else {
 
-        strcpy(vTerm.Command_Mismatch_Type, MismatchType);
-        strcpy(vTerm.Command_Mismatch_Pos_Expected, Expected_Pos);
-        strcpy(vTerm.Command_Mismatch_Pos_Actual, Actual_Pos);
+    if (l_len > Size - 1) l_len = Size - 1;
 
-        if (strstr(MismatchType, "Screen Cursor") == NULL) {
+    memcpy(Text, vTermDataset_Bound, l_len);
 
-            vTermWriteToLog(dupprintf("vTermCommandMismatch|%s", MismatchType), Actual_Pos, Expected_Pos);
+    Text[l_len] = '\0';
+}
 
-            vTerm.Command_Mismatch = true;
+char* vTermControlWord(char** Text) {
 
-        }
-    }
+    char* l_word;
 
-    strcpy(vTerm.Command_Prompt_OK, "No");
+    while (**Text == ' ') (*Text)++;
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog(dupprintf("vTermCommandMismatch - %s|Finish", MismatchType), Actual_Pos, Expected_Pos);
-    }
-}
+    l_word = *Text;
 
-void SendChars(long Hwnd, char* sChars, bool SysKey) {
+    while (**Text != ' ' && **Text != '\0') (*Text)++;
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog("SendChars|", sChars, NULL);
-    }
+    if (**Text == ' ') {
 
-    if (SysKey == true) {
-        SendMessage((HWND)Hwnd, WM_KEYDOWN, (WPARAM)toint(sChars), (LPARAM)0L);
-    }
-    else {
+        **Text = '\0';
 
-        for (int i = 0; sChars[i] != '\0'; i++) {
-            SendMessage((HWND)Hwnd, WM_CHAR, (WPARAM)sChars[i], (LPARAM)0L);
-        }
+        (*Text)++;
     }
-}
 
-bool vTermInputCommandProcessed(char* CalledFrom) {
+    return l_word;
+}
 
-    bool l_proc;
+/* 'LABEL name', 'GOTO name', 'IF_SCREEN name text', 'LOOP name count' and 'NEXT name', separated by ';'. */
+bool vTermControlParse( char* ControlText, vTermCommand* Command) {
 
-    int l_found_row;
-    int l_found_col;
+    vTermControl* control;
 
-    char l_screen[MAX_STRING_LENGTH];
+    char* l_stmt;
+    char* l_rest;
+    char* l_word;
 
-    if (vterm_screen_speed > 0) Sleep(vterm_screen_speed);
+    Command->Label = vTermIntern("");
+    Command->Control_Count = 0;
 
-    if ((strcmp(vTerm.Command_Input_Hidden, "Yes") == 0) || (strlen(vTerm.Command_Processed) <= 0)) {
+    if (strlen(trim(ControlText)) == 0) {
         return true;
     }
 
-    l_found_row = vTerm.Command_Sent_Cursor_Y - vTermScreenWrapAdjust(vTerm.Command_Sent_Cursor_Y - 1);
+    for (l_stmt = strtok(ControlText, ";"); l_stmt != NULL; l_stmt = strtok(NULL, ";")) {
 
-    //l_found_col = instr(vTerm.Screen_Array[l_found_row], rtrim(dupstr(vTerm.Command_Processed)), 0);
-    l_found_col = instr(vTerm.Screen_Array[l_found_row], rtrim(dupstr(vTerm.Command_Processed)), vTerm.Command_Sent_Cursor_X);
+        l_rest = l_stmt;
 
-    if (l_found_row >= 0 && l_found_col >= 0) {
+        l_word = vTermControlWord(&l_rest);
 
-        if (vTermLog_Execution == true) {
-            vTermWriteToLog(dupprintf("vTermInputCommandProcessed #1|%s", CalledFrom), dupprintf("%s %s", vTerm.Command_Sent_Cursor_Pos, vTerm.Screen_Array[l_found_row]), dupprintf("%d,%d %s", l_found_row, l_found_col, vTerm.Command_Processed));
+        if (strlen(l_word) == 0) {
+            continue;
         }
 
-        return true;
-    }
-
-    //l_found_col = instr(String_Array[l_found_row], rtrim(dupstr(vTerm.Command_Processed)), 0);
-    l_found_col = instr(String_Array[l_found_row], rtrim(dupstr(vTerm.Command_Processed)), vTerm.Command_Sent_Cursor_X);
-
-    if (l_found_row >= 0 && l_found_col >= 0) {
-
-        if (vTermLog_Execution == true) {
-            vTermWriteToLog(dupprintf("vTermInputCommandProcessed #2|%s", CalledFrom), dupprintf("%s %s", vTerm.Command_Sent_Cursor_Pos, String_Array[l_found_row]), dupprintf("%d,%d %s", l_found_row, l_found_col, vTerm.Command_Processed));
-        }
+        if (strcmp(l_word, "LABEL") == 0) {
 
-        memset(vTerm.Screen, 0, sizeof(vTerm.Screen));
+            l_word = vTermControlWord(&l_rest);
 
-        strcpy(vTerm.Screen, vTerm.Screen_New);
+            if (strlen(l_word) == 0 || strlen(trim(l_rest)) > 0) {
+                return false;
+            }
 
-        vTerm.Screen_Len = vTerm.Screen_New_Len;
+            Command->Label = vTermIntern(l_word);
 
-        memcpy(vTerm.Screen_Array, String_Array, sizeof(String_Array));
+            continue;
+        }
 
-        vTerm.Screen_Array_Rows = vTerm.Screen_New_Rows;
+        if (Command->Control_Count >= vTerm_Control_Max) {
+            return false;
+        }
 
-        vTermSessionSetValue(vTerm.Screen, vTerm_Screen_pos, vTerm.Command_Seq);
-        vTermSessionSetValue(vTerm.Screen_Command_Seq_From, vTerm_Screen_Command_Seq_pos, vTerm.Command_Seq);
+        control = &Command->Control[Command->Control_Count];
 
-        return true;
-    }
-    else if (l_found_row >= 0) {
+        if (strcmp(l_word, "GOTO") == 0) control->Type = vTerm_Control_Goto;
+        else if (strcmp(l_word, "IF_SCREEN") == 0) control->Type = vTerm_Control_If_Screen;
+        else if (strcmp(l_word, "LOOP") == 0) control->Type = vTerm_Control_Loop;
+        else if (strcmp(l_word, "NEXT") == 0) control->Type = vTerm_Control_Next;
+        else return false;
 
-        if (vTermLog_Execution == true) {
+        l_word = vTermControlWord(&l_rest);
 
-            vTermWriteToLog(dupprintf("vTermInputCommandProcessed #3a|%s - Previous Screen", CalledFrom), dupprintf("%s %s", vTerm.Command_Sent_Cursor_Pos, vTerm.Screen_Array[l_found_row]), dupprintf("%d,%d %s", l_found_row, l_found_col, vTerm.Command_Processed));
-            vTermWriteToLog(dupprintf("vTermInputCommandProcessed #3b|%s - Updated Screen", CalledFrom), dupprintf("%s %s", vTerm.Command_Sent_Cursor_Pos, String_Array[l_found_row]), dupprintf("%d,%d %s", l_found_row, l_found_col, vTerm.Command_Processed));
+        if (strlen(l_word) == 0) {
+            return false;
         }
-    }
-    else {
 
-        if (vTermLog_Execution == true) {
+        control->Label = vTermIntern(l_word);
+        control->Text = vTermIntern(trim(l_rest));
+        control->Target = -1;
+        control->Count = 0;
+        control->Left = -1;
 
-            vTermWriteToLog(dupprintf("vTermInputCommandProcessed #4a|%s - Previous Screen", CalledFrom), dupprintf("%s %s", vTerm.Command_Sent_Cursor_Pos, vTerm.Screen), dupprintf("-1,-1 %s", vTerm.Command_Processed));
-            vTermWriteToLog(dupprintf("vTermInputCommandProcessed #4b|%s - Updated Screen", CalledFrom), dupprintf("%s %s", vTerm.Command_Sent_Cursor_Pos, vTerm.Screen_New), dupprintf("-1,-1 %s", vTerm.Command_Processed));
+        if ((control->Type == vTerm_Control_Goto || control->Type == vTerm_Control_Next) && strlen(control->Text) > 0) {
+            return false;
         }
-    }
-
-    return false;
-}
-
-void vTermCommandSend( bool FullCommand) {
-
-    bool l_submit;
-
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog("vTermCommandSend|Start", NULL, NULL);
-    }
 
-    l_submit = vTermInputCommandProcessed(dupprintf("vTermCommandSend #1|FullCommand - %s", FullCommand ? "true" : "false"));
+        if (control->Type == vTerm_Control_If_Screen && strlen(control->Text) == 0) {
+            return false;
+        }
 
-    if (!l_submit == true) {
+        if (control->Type == vTerm_Control_Loop) {
 
-        vTermSessionGetScreen(false);
+            if (isnumeric(control->Text) != true || atoi(control->Text) <= 0) {
+                return false;
+            }
 
-        if (vTermLog_Execution == true) {
-            vTermWriteToLog("vTermCommandSend|Return", dupprintf("Waiting for command '%s' to process.", vTerm.Command_Processed), NULL);
+            control->Count = atoi(control->Text);
         }
 
-        return;
+        Command->Control_Count++;
     }
 
-    l_submit = false;
-
-    if (vTerm.Command_Send_Buffer_Len > 0) {
-
-        if (FullCommand || strcmp(vTerm.Command_Input_Hidden, "Yes") == 0) {
+    return true;
+}
 
-            strcpy(vTerm.Command_Sent, vTerm.Command_Send);
+/* Jump targets are looked up once every command has been read, so a label may come after its jump. */
+void vTermControlResolve() {
 
-            vTerm.Command_Sent_Len = vTerm.Command_Send_Buffer_Len;
+    vTermControl* control;
 
-            vTerm.Command_Send_Pos = vTerm.Command_Send_Buffer_Len;
-            vTerm.Command_Send_Buffer_Len = 0;
+    int i;
+    int j;
+    int k;
 
-            SendChars(vTerm.Hwnd, vTerm.Command_Send, false);
+    for (i = 1; i <= vTerm.Command_Seq_Max; i++) {
 
-            vTerm.Command_Send_At = time(NULL);
-        }
-        else {
+        for (j = 0; j < vTermCommandAt(i)->Control_Count; j++) {
 
-            vTerm.Command_Send_Pos += 1;
+            control = &vTermCommandAt(i)->Control[j];
 
-            strncat(vTerm.Command_Sent, &vTerm.Command_Send[vTerm.Command_Send_Pos - 1], 1);
+            for (k = 1; k <= vTerm.Command_Seq_Max && control->Target < 0; k++) {
 
-            vTerm.Command_Sent_Len += 1;
-            vTerm.Command_Send_Buffer_Len -= 1;
+                if (strcmp(vTermCommandAt(k)->Label, control->Label) == 0) control->Target = k;
+            }
 
-            char chr[2];
-  
-            chr[0]= vTerm.Command_Send[vTerm.Command_Send_Pos - 1];
-            chr[1] = '\0';
+            if (control->Target < 0) {
 
-            SendChars(vTerm.Hwnd, chr, false);
+                MessageBox(NULL, dupprintf("Fatal Error : Unknown label '%s' in command %d of Script Commands File '%s' - exiting program.", control->Label, i, vterm_script_file), "Putty Driver", MB_ICONERROR | MB_OK);
 
-            vTerm.Command_Send_At = time(NULL);
+                exit(EXIT_FAILURE);
+            }
         }
     }
-    else if (vTerm.Submit_Key_Len > 0) {
-
-        vTerm.Command_Current_Seq = vTerm.Command_Seq;
+}
 
-        strcpy(vTerm.Command_Prompt, vTerm.Command_Prompt_Expected);
+/* The command to run after Command_Seq: the target of its first control that fires, or the next line. */
+int vTermCommandNext(int Command_Seq) {
 
-        vTerm.Command_Prompt_Len = vTerm.Command_Prompt_Expected_Len;
+    vTermCommand* l_cmd;
+    vTermControl* control;
 
-        SendChars(vTerm.Hwnd, vTerm.Submit_Key_ANSI, false);
-        //SendChars(vTerm.Hwnd, vTerm.Submit_Key_Send, true);
+    int i;
 
-        vTerm.Submit_Key_Len = 0;
+    if (Command_Seq < 1 || Command_Seq > vTerm.Command_Seq_Max) {
+        return Command_Seq + 1;
+    }
 
-        vTerm.Command_Send_At = time(NULL);
+    l_cmd = vTermCommandAt(Command_Seq);
 
-        vTerm.Command_Processing = false;
-    }
+    for (i = 0; i < l_cmd->Control_Count; i++) {
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog("vTermCommandSend|Finish", NULL, NULL);
-    }
-}
+        control = &l_cmd->Control[i];
 
-void vTermSendCommand() {
+        if (control->Type == vTerm_Control_If_Screen && (vTerm.Screen_New == NULL || strstr(vTerm.Screen_New, control->Text) == NULL)) {
+            continue;
+        }
 
-    int l_screen_pos;
+        /* Goes round again while the dataset has rows left. */
+        if (control->Type == vTerm_Control_Next && vTermDatasetNext() != true) {
+            continue;
+        }
 
-    int l_sid;
+        if (control->Type == vTerm_Control_Loop) {
 
-    int l_act_X;
-    int l_act_Y;
+            if (control->Left < 0) {
+                control->Left = control->Count;
+            }
 
-    int l_exp_X;
-    int l_exp_Y;
+            /* A finished loop starts over the next time an outer loop comes round to it. */
+            if (control->Left == 0) {
 
-    char* l_control;
+                control->Left = -1;
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog( "vTermSendCommand|", vTerm.Command_Sent, vTerm.Command_Send);
-    }
+                continue;
+            }
 
-    if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
+            control->Left--;
+        }
 
         if (vTermLog_Execution == true) {
-            vTermWriteToLog("vTermSendCommand|Return", dupprintf("No data to send - script finished at command %d", vTerm.Command_Seq_Max), NULL);
+            vTermWriteToLog("vTermCommandNext|Jump", dupprintf("%d", Command_Seq), dupprintf("%s (%d)", control->Label, control->Target));
         }
 
-        return;
+        return control->Target;
     }
 
-    if (vTerm.Command_Send_Buffer_Len + vTerm.Submit_Key_Len <= 0) {
+    return Command_Seq + 1;
+}
 
-        if (vTermLog_Execution == true) {
-            vTermWriteToLog("vTermSendCommand|Return", "No input command set", NULL);
-        }
+void ReadCommandsFromFile() {
 
-        return;
-    }
+    vTermCommand* l_cmd;
 
-    if (vTerm.Command_Mismatch == true) {
+    char* input;
 
-        if (vTermLog_Execution == true) {
-            vTermWriteToLog( "vTermSendCommand|Return", "Command Mismatch = True", NULL);
-        }
+    FILE* stream;
+
+    int l_field;
+    int num = 0;
 
+    if (strlen(trim(vterm_script_file)) == 0) {
         return;
     }
 
-    if (vTerm.Command_Wait_Until > time(NULL)) {
+    if (file_exists(vterm_script_file) != true) {
 
-        if (vTermLog_Execution == true) {
-            vTermWriteToLog( "vTermSendCommand|Waiting", NULL, vTerm.Command_Send);
-        }
+        MessageBox(NULL, dupprintf("Fatal Error : Script Commands File '%s' does not exist - exiting program.", vterm_script_file), "Putty Driver", MB_ICONERROR | MB_OK);
 
-        return;
+        exit(EXIT_FAILURE);
     }
 
-    bool l_waiting = vTerm.Command_Wait;
+    stream = fopen(vterm_script_file, "r");
 
-    vTerm.Command_Wait = 0;
+    if (stream == NULL) {
 
-    bool l_proc = true;
+        MessageBox(NULL, dupprintf("Fatal Error : Cannot open Script Commands File '%s' - exiting program.", vterm_script_file), "Putty Driver", MB_ICONERROR | MB_OK);
 
-    if (vTerm.Command_Current_Seq < vTerm.Command_Seq && vTerm.Command_Send_Buffer_Len + vTerm.Submit_Key_Len > 0) {
+        exit(EXIT_FAILURE);
+    }
+    
+    vTerm.Command_Seq_Max = 0;
+    
+    while ((input = fgetline(stream)) != NULL) {
 
-        if (vTerm.Command_Send_Expected_Cursor_Y < 0 || vTerm.Command_Send_Expected_Cursor_Y == vTerm.Screen_Cursor.Y) {
+        if (strlen(input) > vTerm_Command_Elements) {
 
-            if (vTerm.Command_Send_Expected_Cursor_X < 0 || 
-                vTerm.Command_Send_Expected_Cursor_X == vTerm.Screen_Cursor.X - vTerm.Command_Send_Pos || 
-                (vTerm.Command_Send_Expected_Cursor_X == vTerm.Screen_Cursor.X && strstr(vTerm.Command_Input_Hidden, "Yes") != NULL)) {
+            num = string_split(input, '|', vTerm_Command_Elements_Control, (int)strlen(input) + 1, true);
 
-                if (SessionsKeyPressSync == true || vTerm.Command_Send_Pos <= 0 || vTerm.Command_Send_Pos == vTerm.Command_Send_Buffer_Len) {
-                    vTermSessionGetScreen( false);
-                }
+            if (num != vTerm_Command_Elements && num != vTerm_Command_Elements_Watch && num != vTerm_Command_Elements_Control) {
 
-                l_proc = true;
+                MessageBox(NULL, dupprintf("Fatal Error : Data mismatch reading Script Commands File '%s' line %d - exiting program.", vterm_script_file, vTerm.Command_Seq_Max + 1), "Putty Driver", MB_ICONERROR | MB_OK);
 
-                if (vTerm.Command_Screen_Identifier_Len > 0) {
+                fclose(stream);
 
-                    if (strstr(vTerm.Screen, vTerm.Command_Screen_Identifier) != NULL) {
+                exit(EXIT_FAILURE);
 
-                        strcpy(vTerm.Screen_Identifier_Pos, vTermScreenTextPosition(vTerm.Command_Screen_Identifier, false));
+            }
+            else {
 
-                        if (strlen(trim(vTerm.Screen_Identifier_Pos)) > 0) {
+                /* Only the text to send may be longer than MAX_STRING_LENGTH, the other fields are copied into fixed size buffers. */
+                for (l_field = 0; l_field <= num; l_field++) {
 
-                            vTermSessionSetValue(vTerm.Screen_Identifier_Pos, vTerm_Screen_Identifier_At_pos, vTerm.Command_Seq);
+                    if (l_field != vTerm_Command_Send_pos && strlen(String_Array[l_field]) >= MAX_STRING_LENGTH) {
 
-                            if (vTerm.Command_Screen_Identifier_Pos_Y < 0 || vTerm.Command_Screen_Identifier_Pos_Y == vTermScreenText_Pos_Y) {
+                        MessageBox(NULL, dupprintf("Fatal Error : Field %d longer than %d characters reading Script Commands File '%s' line %d - exiting program.", l_field + 1, MAX_STRING_LENGTH - 1, vterm_script_file, vTerm.Command_Seq_Max + 1), "Putty Driver", MB_ICONERROR | MB_OK);
 
-                                if (vTerm.Command_Screen_Identifier_Pos_X < 0 || vTerm.Command_Screen_Identifier_Pos_X == vTermScreenText_Pos_X) {
+                        fclose(stream);
 
-                                    vTermSessionSetValue(vTerm.Screen_Identifier_Pos, vTerm_Screen_Identifier_At_pos, vTerm.Command_Seq);
+                        exit(EXIT_FAILURE);
+                    }
+                }
 
-                                    if (vTermLog_Execution == true) {
-                                        vTermWriteToLog(dupprintf("Screen Identifier '%s' Position Matches OK (expected at %s)", vTerm.Command_Screen_Identifier, vTerm.Command_Screen_Identifier_Pos), vTerm.Screen_Identifier_Pos, vTerm.Command_Screen_Identifier_Pos);
-                                    }
-                                }
-                                else {
+                vTerm.Command_Seq = atoi(ifnull(String_Array[vTerm_Command_Seq_pos], "0"));
 
-                                    l_proc = false;
+                if (vTerm.Command_Seq <= 0) {
+                    // Script default params - ignore.
+                }
+                else {
+                    
+                    vTerm.Command_Seq_Max++;
+                
+                    if (vTerm.Command_Seq != vTerm.Command_Seq_Max) {
+
+                        MessageBox(NULL, dupprintf("Fatal Error : 'Command_Seq' data mismatch reading Script Commands File '%s' line %d - exiting program.", vterm_script_file, vTerm.Command_Seq_Max + 1), "Putty Driver", MB_ICONERROR | MB_OK);
+
+                        fclose(stream);
+
+                        exit(EXIT_FAILURE);
+
+                    }
+                    
+                    l_cmd = vTermCommandAt(vTerm.Command_Seq_Max);
+
+                    l_cmd->Field[vTerm_Command_Seq_pos] = vTermIntern(ifnull(String_Array[vTerm_Command_Seq_pos], "0"));
+                    l_cmd->Field[vTerm_Expected_Screen_Identifier_pos] = vTermIntern(ifnull(String_Array[vTerm_Expected_Screen_Identifier_pos], ""));
+                    l_cmd->Field[vTerm_Expected_Screen_Identifier_At_pos] = vTermIntern(ifnull(String_Array[vTerm_Expected_Screen_Identifier_At_pos], ""));
+                    l_cmd->Field[vTerm_Screen_Capture_OnOff_pos] = vTermIntern(ifnull(String_Array[vTerm_Screen_Capture_OnOff_pos], ""));
+                    l_cmd->Field[vTerm_Expected_Command_Prompt_pos] = vTermIntern(ifnull(String_Array[vTerm_Expected_Command_Prompt_pos], ""));
+                    l_cmd->Field[vTerm_Expected_Command_Prompt_At_pos] = vTermIntern(ifnull(String_Array[vTerm_Expected_Command_Prompt_At_pos], ""));
+                    l_cmd->Field[vTerm_Expected_Input_Cursor_At_pos] = vTermIntern(ifnull(String_Array[vTerm_Expected_Input_Cursor_At_pos], ""));
+                    l_cmd->Field[vTerm_Command_Send_pos] = vTermIntern(ifnull(String_Array[vTerm_Command_Send_pos], ""));
+                    l_cmd->Field[vTerm_Command_Input_Hidden_pos] = vTermIntern(ifnull(String_Array[vTerm_Command_Input_Hidden_pos], ""));
+                    l_cmd->Field[vTerm_Command_Submit_Key_pos] = vTermIntern(ifnull(String_Array[vTerm_Command_Submit_Key_pos], ""));
+                    l_cmd->Field[vTerm_Command_Send_Pause_pos] = vTermIntern(ifnull(String_Array[vTerm_Command_Send_Pause_pos], ""));
+                    l_cmd->Field[vTerm_DBRecord_Script_Cmd_ID_pos] = vTermIntern(ifnull(String_Array[vTerm_DBRecord_Script_Cmd_ID_pos], "0"));
+
+                    vTermCommandCompile(l_cmd);
+
+                    /* Optional column after the fixed ones, the screen areas this command's identifier and prompt are looked for in. */
+                    if (num >= vTerm_Command_Elements_Watch && vTermWatchParse(String_Array[vTerm_Command_Elements], &l_cmd->Watch) != true) {
+
+                        MessageBox(NULL, dupprintf("Fatal Error : Invalid screen watch '%s' reading Script Commands File '%s' line %d - exiting program.", String_Array[vTerm_Command_Elements], vterm_script_file, vTerm.Command_Seq_Max), "Putty Driver", MB_ICONERROR | MB_OK);
+
+                        fclose(stream);
+
+                        exit(EXIT_FAILURE);
+                    }
+
+                    /* Optional column after that, labels and the jumps taken once this command has been processed. */
+                    if (num == vTerm_Command_Elements_Control && vTermControlParse(String_Array[vTerm_Command_Elements_Watch], l_cmd) != true) {
+
+                        MessageBox(NULL, dupprintf("Fatal Error : Invalid control '%s' reading Script Commands File '%s' line %d - exiting program.", String_Array[vTerm_Command_Elements_Watch], vterm_script_file, vTerm.Command_Seq_Max), "Putty Driver", MB_ICONERROR | MB_OK);
+
+                        fclose(stream);
+
+                        exit(EXIT_FAILURE);
+                    }
+
+                    vTermSetCommand();
+
+                    vTermMatchAddPattern(l_cmd->Field[vTerm_Expected_Screen_Identifier_pos]);
+                    vTermMatchAddPattern(l_cmd->Field[vTerm_Expected_Command_Prompt_pos]);
+                } 
+            }
+        }
+
+        sfree(input);
+    }
+
+    fclose(stream);
+
+    vTermControlResolve();
+
+    /* All the script's screen identifiers and prompts are found in one pass over the screen. */
+    vTermMatchBuild();
+}
+
+bool vTermImageSourceRead(const char* File, vTermImageSource* Source, bool Hash) {
+
+    struct stat l_stat;
+
+    FILE* stream;
+
+    char* l_data;
+
+    if (stat(File, &l_stat) != 0) {
+        return false;
+    }
+
+    Source->Mtime = (int64_t)l_stat.st_mtime;
+    Source->Size = (int64_t)l_stat.st_size;
+    Source->Hash = 0;
+
+    if (Hash != true) {
+        return true;
+    }
+
+    stream = fopen(File, "rb");
+
+    if (stream == NULL) {
+        return false;
+    }
+
+    l_data = snewn((size_t)Source->Size + 1, char);
+
+    if (fread(l_data, 1, (size_t)Source->Size, stream) != (size_t)Source->Size) {
+
+        sfree(l_data);
+
+        fclose(stream);
+
+        return false;
+    }
+
+    fclose(stream);
+
+    Source->Hash = vTermScreenRowHash(l_data, (int)Source->Size);
+
+    sfree(l_data);
+
+    return true;
+}
+
+/* Same size and mtime is taken as unchanged; a touched or copied file is compared by content. */
+bool vTermImageSourceMatch(const vTermImageSource* Image, const char* File) {
+
+    vTermImageSource l_source;
+
+    if (vTermImageSourceRead(File, &l_source, false) != true || l_source.Size != Image->Size) {
+        return false;
+    }
+
+    if (l_source.Mtime == Image->Mtime) {
+        return true;
+    }
+
+    return (vTermImageSourceRead(File, &l_source, true) == true && l_source.Hash == Image->Hash);
+}
+
+uint32_t vTermImagePut(const void* Data, size_t Len) {
+
+    size_t l_off = (vTermImageBuild_Len + 7) & ~(size_t)7;
+
+    sgrowarrayn(vTermImageBuild, vTermImageBuild_Size, l_off, Len);
+
+    memset(vTermImageBuild + vTermImageBuild_Len, 0, l_off - vTermImageBuild_Len);
+
+    if (Len > 0) {
+        memcpy(vTermImageBuild + l_off, Data, Len);
+    }
+
+    vTermImageBuild_Len = l_off + Len;
+
+    return (uint32_t)l_off;
+}
+
+/* Written after a text load so the next session with the same script and key codes can map it instead. */
+void vTermImageSave() {
+
+    vTermImageHeader l_header;
+    vTermImageCommand* l_records;
+    vTermCommand* l_cmd;
+
+    uint32_t* l_key_fields;
+
+    char* l_image_file;
+    char* l_temp_file;
+
+    FILE* stream;
+
+    bool l_written;
+
+    int i;
+    int j;
+
+    if (strlen(trim(vterm_script_file)) == 0 || vTerm.Command_Seq_Max <= 0) {
+        return;
+    }
+
+    memset(&l_header, 0, sizeof(l_header));
+
+    memcpy(l_header.Magic, vTerm_Image_Magic, sizeof(l_header.Magic));
+
+    l_header.Version = vTerm_Image_Version;
+    l_header.Command_Record = sizeof(vTermImageCommand);
+
+    if (vTermImageSourceRead(vterm_script_file, &l_header.Script, true) != true || vTermImageSourceRead(vterm_keycodes_file, &l_header.Keys, true) != true) {
+        return;
+    }
+
+    vTermImageBuild_Len = 0;
+
+    vTermImagePut(&l_header, sizeof(l_header));
+
+    l_header.Keys_File = vTermImagePut(vterm_keycodes_file, strlen(vterm_keycodes_file) + 1);
+
+    l_key_fields = snewn((size_t)(vTermKeyCodes_Count > 0 ? vTermKeyCodes_Count : 1) * (vTerm_KeyANSI + 1), uint32_t);
+
+    for (i = 0; i < vTermKeyCodes_Count; i++) {
+
+        for (j = 0; j <= vTerm_KeyANSI; j++) {
+            l_key_fields[i * (vTerm_KeyANSI + 1) + j] = vTermImagePut(vTermKeyCodes[i].Field[j], strlen(vTermKeyCodes[i].Field[j]) + 1);
+        }
+    }
+
+    l_header.Key_Count = vTermKeyCodes_Count;
+    l_header.Key_Off = vTermImagePut(l_key_fields, (size_t)vTermKeyCodes_Count * (vTerm_KeyANSI + 1) * sizeof(uint32_t));
+
+    l_header.Key_Names_Size = vTermKeyNames_Size;
+    l_header.Key_Names_Off = vTermImagePut(vTermKeyNames, (size_t)vTermKeyNames_Size * sizeof(int));
+
+    l_header.Key_States_Count = vTermKeyStates_Count;
+    l_header.Key_States_Off = vTermImagePut(vTermKeyStates, (size_t)vTermKeyStates_Count * sizeof(vTermKeyState));
+
+    sfree(l_key_fields);
+
+    l_records = snewn(vTerm.Command_Seq_Max, vTermImageCommand);
+
+    memset(l_records, 0, vTerm.Command_Seq_Max * sizeof(vTermImageCommand));
+
+    for (i = 0; i < vTerm.Command_Seq_Max; i++) {
+
+        l_cmd = vTermCommandAt(i + 1);
+
+        for (j = 0; j < vTerm_Command_Elements; j++) {
+            l_records[i].Field[j] = vTermImagePut(l_cmd->Field[j], strlen(l_cmd->Field[j]) + 1);
+        }
+
+        l_records[i].Send = vTermImagePut(l_cmd->Send, strlen(l_cmd->Send) + 1);
+        l_records[i].Paste = (l_cmd->Paste == true);
+        l_records[i].Identifier_At = l_cmd->Identifier_At;
+        l_records[i].Prompt_At = l_cmd->Prompt_At;
+        l_records[i].Cursor_At = l_cmd->Cursor_At;
+        l_records[i].Send_Pause = l_cmd->Send_Pause;
+        l_records[i].Timeout = l_cmd->Timeout;
+        l_records[i].Script_DB_ID = l_cmd->Script_DB_ID;
+        l_records[i].Watch = l_cmd->Watch;
+        l_records[i].Label = vTermImagePut(l_cmd->Label, strlen(l_cmd->Label) + 1);
+        l_records[i].Control_Count = l_cmd->Control_Count;
+
+        for (j = 0; j < l_cmd->Control_Count; j++) {
+
+            l_records[i].Control[j].Type = l_cmd->Control[j].Type;
+            l_records[i].Control[j].Label = vTermImagePut(l_cmd->Control[j].Label, strlen(l_cmd->Control[j].Label) + 1);
+            l_records[i].Control[j].Text = vTermImagePut(l_cmd->Control[j].Text, strlen(l_cmd->Control[j].Text) + 1);
+            l_records[i].Control[j].Target = l_cmd->Control[j].Target;
+            l_records[i].Control[j].Count = l_cmd->Control[j].Count;
+        }
+    }
+
+    l_header.Command_Count = vTerm.Command_Seq_Max;
+    l_header.Command_Off = vTermImagePut(l_records, vTerm.Command_Seq_Max * sizeof(vTermImageCommand));
+
+    sfree(l_records);
+
+    l_header.Size = (uint32_t)vTermImageBuild_Len;
+
+    memcpy(vTermImageBuild, &l_header, sizeof(l_header));
+
+    l_image_file = dupprintf("%s%s", vterm_script_file, vTerm_Image_Suffix);
+    l_temp_file = dupprintf("%s.%d", l_image_file, (int)getpid());
+
+    stream = fopen(l_temp_file, "wb");
+
+    if (stream != NULL) {
+
+        l_written = (fwrite(vTermImageBuild, 1, vTermImageBuild_Len, stream) == vTermImageBuild_Len);
+
+        l_written = (fclose(stream) == 0) && l_written;
+
+        /* Sessions started together may each write one; the last rename wins and a mapped image is left alone. */
+        if (l_written != true || MoveFileEx(l_temp_file, l_image_file, MOVEFILE_REPLACE_EXISTING) == 0) {
+            remove(l_temp_file);
+        }
+    }
+
+    sfree(l_temp_file);
+    sfree(l_image_file);
+
+    sfree(vTermImageBuild);
+
+    vTermImageBuild = NULL;
+    vTermImageBuild_Size = 0;
+    vTermImageBuild_Len = 0;
+}
+
+bool vTermImageRange(uint32_t Off, int32_t Count, size_t Item, size_t Size) {
+
+    return (Off <= Size && Count >= 0 && (size_t)Count <= (Size - Off) / Item);
+}
+
+/* A string the image points at must start inside it and end before the end of the file. */
+bool vTermImageString(char* Image, size_t Size, uint32_t Off) {
+
+    return (Off < Size && memchr(Image + Off, '\0', Size - Off) != NULL);
+}
+
+bool vTermImageValid(char* Image, size_t Size) {
+
+    vTermImageHeader* l_header = (vTermImageHeader*)Image;
+    vTermImageCommand* l_record;
+    vTermImageControl* l_control;
+    vTermKeyState* l_states;
+
+    uint32_t* l_key_fields;
+
+    int* l_names;
+
+    bool l_empty;
+
+    int i;
+    int j;
+
+    if (memcmp(l_header->Magic, vTerm_Image_Magic, sizeof(l_header->Magic)) != 0 || l_header->Version != vTerm_Image_Version) {
+        return false;
+    }
+
+    if (l_header->Size != Size || l_header->Command_Record != sizeof(vTermImageCommand)) {
+        return false;
+    }
+
+    if (vTermImageRange(l_header->Key_Off, l_header->Key_Count, (vTerm_KeyANSI + 1) * sizeof(uint32_t), Size) != true ||
+        vTermImageRange(l_header->Key_Names_Off, l_header->Key_Names_Size, sizeof(int), Size) != true ||
+        vTermImageRange(l_header->Key_States_Off, l_header->Key_States_Count, sizeof(vTermKeyState), Size) != true ||
+        vTermImageRange(l_header->Command_Off, l_header->Command_Count, sizeof(vTermImageCommand), Size) != true) {
+        return false;
+    }
+
+    /* The name lookup masks by its size and the trie walk starts at state 0. */
+    if (l_header->Key_Names_Size <= 0 || (l_header->Key_Names_Size & (l_header->Key_Names_Size - 1)) != 0 || l_header->Key_States_Count <= 0) {
+        return false;
+    }
+
+    if (vTermImageString(Image, Size, l_header->Keys_File) != true || strcmp(Image + l_header->Keys_File, vterm_keycodes_file) != 0) {
+        return false;
+    }
+
+    /* Everything the loaded tables point or index into, so a damaged file falls back to the text files rather than crashing later. */
+    l_key_fields = (uint32_t*)(Image + l_header->Key_Off);
+
+    for (i = 0; i < l_header->Key_Count * (vTerm_KeyANSI + 1); i++) {
+
+        if (vTermImageString(Image, Size, l_key_fields[i]) != true) {
+            return false;
+        }
+    }
+
+    l_names = (int*)(Image + l_header->Key_Names_Off);
+
+    l_empty = false;
+
+    /* The name probe stops at the first empty slot, so there must be one. */
+    for (i = 0; i < l_header->Key_Names_Size; i++) {
+
+        if (l_names[i] < 0) {
+            l_empty = true;
+        }
+        else if (l_names[i] >= l_header->Key_Count) {
+            return false;
+        }
+    }
+
+    if (l_empty != true) {
+        return false;
+    }
+
+    l_states = (vTermKeyState*)(Image + l_header->Key_States_Off);
+
+    for (i = 0; i < l_header->Key_States_Count; i++) {
+
+        if (l_states[i].Child < -1 || l_states[i].Child >= l_header->Key_States_Count ||
+            l_states[i].Sibling < -1 || l_states[i].Sibling >= l_header->Key_States_Count ||
+            l_states[i].Key < -1 || l_states[i].Key >= l_header->Key_Count) {
+            return false;
+        }
+    }
+
+    for (i = 0; i < l_header->Command_Count; i++) {
+
+        l_record = (vTermImageCommand*)(Image + l_header->Command_Off) + i;
+
+        for (j = 0; j < vTerm_Command_Elements; j++) {
+
+            if (vTermImageString(Image, Size, l_record->Field[j]) != true) {
+                return false;
+            }
+        }
+
+        if (vTermImageString(Image, Size, l_record->Send) != true || vTermImageString(Image, Size, l_record->Label) != true) {
+            return false;
+        }
+
+        if (l_record->Watch.Count < 0 || l_record->Watch.Count > vTerm_Screen_Watch_Max || l_record->Control_Count < 0 || l_record->Control_Count > vTerm_Control_Max) {
+            return false;
+        }
+
+        for (j = 0; j < l_record->Control_Count; j++) {
+
+            l_control = &l_record->Control[j];
+
+            if (l_control->Type < vTerm_Control_Goto || l_control->Type > vTerm_Control_Next ||
+                vTermImageString(Image, Size, l_control->Label) != true || vTermImageString(Image, Size, l_control->Text) != true ||
+                l_control->Target < 1 || l_control->Target > l_header->Command_Count ||
+                (l_control->Type == vTerm_Control_Loop && l_control->Count <= 0)) {
+                return false;
+            }
+        }
+    }
+
+    return (vTermImageSourceMatch(&l_header->Script, vterm_script_file) == true && vTermImageSourceMatch(&l_header->Keys, vterm_keycodes_file) == true);
+}
+
+/* Maps a current image and points the key code tables straight into it; NULL means load the text files. */
+char* vTermImageLoad() {
+
+    vTermImageHeader* l_header;
+
+    uint32_t* l_key_fields;
+
+    char* l_image = NULL;
+    char* l_image_file;
+
+    HANDLE l_file;
+    HANDLE l_map;
+
+    DWORD l_size;
+
+    int i;
+    int j;
+
+    if (strlen(trim(vterm_script_file)) == 0) {
+        return NULL;
+    }
+
+    l_image_file = dupprintf("%s%s", vterm_script_file, vTerm_Image_Suffix);
+
+    l_file = CreateFile(l_image_file, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    sfree(l_image_file);
+
+    if (l_file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+
+    l_size = GetFileSize(l_file, NULL);
+
+    if (l_size >= sizeof(vTermImageHeader)) {
+
+        l_map = CreateFileMapping(l_file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+
+        /* Copy on write, so nothing the driver does to a mapped string can reach the file. */
+        if (l_map != NULL) {
+
+            l_image = MapViewOfFile(l_map, FILE_MAP_COPY, 0, 0, 0);
+
+            CloseHandle(l_map);
+        }
+    }
+
+    CloseHandle(l_file);
+
+    if (l_image == NULL) {
+        return NULL;
+    }
+
+    if (vTermImageValid(l_image, l_size) != true) {
+
+        UnmapViewOfFile(l_image);
+
+        return NULL;
+    }
+
+    l_header = (vTermImageHeader*)l_image;
+
+    l_key_fields = (uint32_t*)(l_image + l_header->Key_Off);
+
+    vTermKeyCodes_Count = l_header->Key_Count;
+    vTermKeyCodes_Size = (l_header->Key_Count > 0 ? l_header->Key_Count : 1);
+
+    vTermKeyCodes = snewn(vTermKeyCodes_Size, vTermKeyCode);
+
+    for (i = 0; i < vTermKeyCodes_Count; i++) {
+
+        for (j = 0; j <= vTerm_KeyANSI; j++) {
+            vTermKeyCodes[i].Field[j] = l_image + l_key_fields[i * (vTerm_KeyANSI + 1) + j];
+        }
+    }
+
+    vTermKeyNames = (int*)(l_image + l_header->Key_Names_Off);
+    vTermKeyNames_Size = l_header->Key_Names_Size;
+
+    vTermKeyStates = (vTermKeyState*)(l_image + l_header->Key_States_Off);
+    vTermKeyStates_Size = l_header->Key_States_Count;
+    vTermKeyStates_Count = l_header->Key_States_Count;
+
+    return l_image;
+}
+
+void vTermImageCommands(char* Image) {
+
+    vTermImageHeader* l_header = (vTermImageHeader*)Image;
+    vTermImageCommand* l_record;
+    vTermCommand* l_cmd;
+
+    int i;
+    int j;
+
+    vTerm.Command_Seq_Max = 0;
+
+    for (i = 0; i < l_header->Command_Count; i++) {
+
+        l_record = (vTermImageCommand*)(Image + l_header->Command_Off) + i;
+
+        vTerm.Command_Seq_Max++;
+
+        vTerm.Command_Seq = vTerm.Command_Seq_Max;
+
+        l_cmd = vTermCommandAt(vTerm.Command_Seq_Max);
+
+        for (j = 0; j < vTerm_Command_Elements; j++) {
+            l_cmd->Field[j] = Image + l_record->Field[j];
+        }
+
+        l_cmd->Send = Image + l_record->Send;
+        l_cmd->Paste = (l_record->Paste != 0);
+        l_cmd->Identifier_At = l_record->Identifier_At;
+        l_cmd->Prompt_At = l_record->Prompt_At;
+        l_cmd->Cursor_At = l_record->Cursor_At;
+        l_cmd->Send_Pause = l_record->Send_Pause;
+        l_cmd->Timeout = l_record->Timeout;
+
+        if (l_cmd->Timeout > 0) vTermCommands_Timeout = true;
+        l_cmd->Script_DB_ID = (long)l_record->Script_DB_ID;
+        l_cmd->Watch = l_record->Watch;
+        l_cmd->Label = Image + l_record->Label;
+        l_cmd->Control_Count = (l_record->Control_Count < vTerm_Control_Max ? l_record->Control_Count : vTerm_Control_Max);
+
+        for (j = 0; j < l_cmd->Control_Count; j++) {
+
+            l_cmd->Control[j].Type = l_record->Control[j].Type;
+            l_cmd->Control[j].Label = Image + l_record->Control[j].Label;
+            l_cmd->Control[j].Text = Image + l_record->Control[j].Text;
+            l_cmd->Control[j].Target = l_record->Control[j].Target;
+            l_cmd->Control[j].Count = l_record->Control[j].Count;
+            l_cmd->Control[j].Left = -1;
+        }
+
+        vTermSetCommand();
+
+        vTermMatchAddPattern(l_cmd->Field[vTerm_Expected_Screen_Identifier_pos]);
+        vTermMatchAddPattern(l_cmd->Field[vTerm_Expected_Command_Prompt_pos]);
+    }
+
+    vTermMatchBuild();
+}
+
+void vTermOpenSessionFiles() {
+
+    char cwdpath[MAX_FILENAME_SIZE];
+
+    char capture_file[MAX_FILENAME_SIZE];
+    char capture_script_file[MAX_FILENAME_SIZE];
+
+    char host_name[MAX_FILENAME_SIZE];
+    char script_name[MAX_FILENAME_SIZE];
+
+    char* host;
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog("vTermOpenSessionFiles|Start", NULL, NULL);
+    }
+
+    if (vterm_nocapture != true) {
+
+        getcwd(cwdpath, MAX_FILENAME_SIZE);
+
+        host = strtok(dupprintf("%s", vterm_hostname), ".");
+
+        if (host != NULL)
+            strcpy(host_name, host);
+        else
+            strcpy(host_name, vterm_hostname);
+
+        strcpy(script_name, vTermGetFileName(vterm_script_file, false));
+
+        if (!(vterm_nolog == true)) {
+
+            if (instrrev(vterm_log_file, "\\") < 0) {
+
+                if (strlen(vterm_log_file) <= 0 ||
+                    stricmp(vterm_log_file, "yes") == 0 ||
+                    stricmp(vterm_log_file, "on") == 0) {
+
+                    if (vterm_sessionid > 0) {
+                        strcpy(vterm_log_file, dupprintf("%s_%d_%s", host_name, vterm_sessionid, script_name, false));
+                    }
+                    else if (vterm_script == true) {
+
+                        if (instr(vterm_script_file, host_name, true) >= 0)
+                            strcpy(vterm_log_file, script_name);
+                        else
+                            strcpy(vterm_log_file, dupprintf("%s_%s", host_name, script_name));
+
+                    }
+                    else
+                        strcpy(vterm_log_file, dupprintf("%s_new_script", host_name));
+                }
+            }
+
+            if (strlen(vterm_log_file) > 0) {
+
+                if (instrrev(vterm_log_file, "\\") < 0) {
+                    strcpy(vterm_log_file, dupstr(vTermSetFileName("Logs", dupstr(vterm_log_file), "log", true, false)));
+                }
+
+                if (file_exists(vterm_log_file) == true) {
+
+                    MessageBox(NULL, dupprintf("Fatal Error : Session screens capture file '%s' already exists - exiting program.", vterm_log_file), "Putty Driver", MB_ICONERROR | MB_OK);
+
+                    exit(EXIT_FAILURE);
+
+                }
+            }
+
+            vTermInitialiseLogs();
+        }
+
+        if (instrrev(vterm_capture_file, "\\") < 0) {
+
+            if (strlen(vterm_capture_file) <= 0 ||
+                stricmp(vterm_capture_file, "yes") == 0 ||
+                stricmp(vterm_capture_file, "on") == 0) {
+
+                if (vterm_sessionid > 0) {
+                    strcpy(vterm_capture_file, dupprintf("%s_%d_%s", host_name, vterm_sessionid, script_name));
+                }
+                else if (vterm_script == true) {
+
+                    if (instr(script_name, host_name, true) >= 0)
+                        strcpy(vterm_capture_file, script_name);
+                    else
+                        strcpy(vterm_capture_file, dupprintf("%s_%s", host_name, script_name));
+
+                }
+                else
+                    strcpy(vterm_capture_file, dupprintf("%s_new_script", host_name));
+            }
+        }
+
+        if (strlen(vterm_capture_file) > 0) {
+
+            if (instrrev(vterm_capture_file, "\\") < 0) {
+                strcpy(vterm_capture_file, dupstr(vTermSetFileName("Capture", dupstr(vterm_capture_file), "log", true, false)));
+            }
+
+            if (file_exists(vterm_capture_file) == true) {
+
+                MessageBox(NULL, dupprintf("Fatal Error : Session screens capture file '%s' already exists - exiting program.", vterm_capture_file), "Putty Driver", MB_ICONERROR | MB_OK);
+
+                exit(EXIT_FAILURE);
+
+            }
+
+            vTermCapture_Stream = fopen(vterm_capture_file, "w");
+
+            if (vTermCapture_Stream == NULL) {
+
+                MessageBox(NULL, dupprintf("Fatal Error : Session screens capture file '%s' create failed - exiting program.", vterm_capture_file), "Putty Driver", MB_ICONERROR | MB_OK);
+
+                exit(EXIT_FAILURE);
+
+            }
+        }
+
+        if (vterm_script != true) {
+
+            strcpy(capture_script_file, vTermGetFileName(vterm_capture_file, false));
+
+            if (instrrev(capture_script_file, "\\") < 0) {
+                strcpy(capture_script_file, dupstr(vTermSetFileName("Capture", dupstr(capture_script_file), "inputs", false, false)));
+            }
+
+            if (file_exists(capture_script_file) == true) {
+
+                MessageBox(NULL, dupprintf("Fatal Error : Session inputs capture file '%s' already exists - exiting program.", capture_script_file), "Putty Driver", MB_ICONERROR | MB_OK);
+
+                exit(EXIT_FAILURE);
+
+            }
+
+            vTermCaptureInputs_Stream = fopen(capture_script_file, "w");
+
+            if (vTermCaptureInputs_Stream == NULL) {
+
+                MessageBox(NULL, dupprintf("Fatal Error : Session inputs capture file '%s' create failed - exiting program.", capture_script_file), "Putty Driver", MB_ICONERROR | MB_OK);
+
+                exit(EXIT_FAILURE);
+
+            }
+        }
+
+        fprintf(vTermCapture_Stream, "<?xml version=""1.0"" encoding=""UTF-8"" standalone=""yes""?>\n");
+        fprintf(vTermCapture_Stream, "<events_log xmlns:xsi=""http://www.w3.org/2001/XMLSchema-instance"">\n");
+
+        fprintf(vTermCapture_Stream, dupprintf("<user>%s</user>\n", get_username()));
+        fprintf(vTermCapture_Stream, dupprintf("<session_id>%d</session_id>\n", vterm_sessionid));
+
+        fflush(vTermCapture_Stream);
+    }
+    
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog("vTermOpenSessionFiles|Finish", NULL, NULL);
+    }
+}
+
+void vTermScreenUnshare( bool Keep) {
+
+    char* l_text;
+
+    size_t l_size;
+
+    if (vTerm.Screen == NULL || vTerm.Screen != vTerm.Screen_New) return;
+
+    /* .Screen moves to the spare buffer before it is changed, leaving .Screen_New as it is. */
+    l_text = vTerm.Screen_Spare;
+    l_size = vTerm.Screen_Spare_Size;
+
+    vTerm.Screen_Spare = NULL;
+    vTerm.Screen_Spare_Size = 0;
+
+    sgrowarray(l_text, l_size, vTerm.Screen_New_Len);
+
+    if (Keep == true)
+        strcpy(l_text, vTerm.Screen_New);
+    else
+        l_text[0] = '\0';
+
+    vTerm.Screen = l_text;
+    vTerm.Screen_Size = l_size;
+}
+
+int vTermCaptureSplit( char* ScreenText, char** Text, size_t* Text_Size, int** Line, size_t* Line_Size) {
+
+    int len;
+    int lines;
+    int i;
+
+    len = strlen(ScreenText);
+
+    sgrowarray(*Text, *Text_Size, len);
+
+    memcpy(*Text, ScreenText, len + 1);
+
+    lines = 0;
+
+    sgrowarray(*Line, *Line_Size, lines);
+
+    (*Line)[lines++] = 0;
+
+    /* Lines are split in place, each starting at its offset into Text. */
+    for (i = 0; i < len; i++) {
+
+        if ((*Text)[i] == '\n') {
+
+            (*Text)[i] = '\0';
+
+            sgrowarray(*Line, *Line_Size, lines);
+
+            (*Line)[lines++] = i + 1;
+        }
+    }
+
+    return lines;
+}
+
+void vTermCaptureWriteScreen( char* ScreenText) {
+
+    char* l_text;
+    int* l_line;
+
+    size_t l_size;
+
+    int l_lines;
+    int row;
+
+    l_lines = vTermCaptureSplit(ScreenText, &vTermCapture_New_Text, &vTermCapture_New_Text_Size, &vTermCapture_New_Line, &vTermCapture_New_Line_Size);
+
+    /* A full screen every 'capturedelta' screens, otherwise only the rows that differ from the previous screen. */
+    if (vTermCapture_Screens % vterm_capture_delta == 0) {
+
+        fprintf(vTermCapture_Stream, "<screen>\n%s\n</screen>\n", ScreenText);
+    }
+    else {
+
+        fprintf(vTermCapture_Stream, "<screen_delta>\n<screen_rows>%d</screen_rows>\n", l_lines);
+
+        for (row = 0; row < l_lines; row++) {
+
+            if (row >= vTermCapture_Lines || strcmp(vTermCapture_New_Text + vTermCapture_New_Line[row], vTermCapture_Text + vTermCapture_Line[row]) != 0) {
+                fprintf(vTermCapture_Stream, "<screen_row>%d|%s</screen_row>\n", row, vTermCapture_New_Text + vTermCapture_New_Line[row]);
+            }
+        }
+
+        fprintf(vTermCapture_Stream, "</screen_delta>\n");
+    }
+
+    /* The new screen becomes the previous screen. */
+    l_text = vTermCapture_Text;
+    l_size = vTermCapture_Text_Size;
+
+    vTermCapture_Text = vTermCapture_New_Text;
+    vTermCapture_Text_Size = vTermCapture_New_Text_Size;
+
+    vTermCapture_New_Text = l_text;
+    vTermCapture_New_Text_Size = l_size;
+
+    l_line = vTermCapture_Line;
+    l_size = vTermCapture_Line_Size;
+
+    vTermCapture_Line = vTermCapture_New_Line;
+    vTermCapture_Line_Size = vTermCapture_New_Line_Size;
+
+    vTermCapture_New_Line = l_line;
+    vTermCapture_New_Line_Size = l_size;
+
+    vTermCapture_Lines = l_lines;
+
+    vTermCapture_Screens++;
+}
+
+int vTermCaptureReadLine( FILE* Stream, char** Input, size_t* Input_Size) {
+
+    int ch;
+    int len = 0;
+
+    while ((ch = fgetc(Stream)) != EOF && ch != '\n') {
+
+        sgrowarray(*Input, *Input_Size, len + 1);
+
+        (*Input)[len++] = (char)ch;
+    }
+
+    if (ch == EOF && len == 0) return -1;
+
+    sgrowarray(*Input, *Input_Size, len);
+
+    (*Input)[len] = '\0';
+
+    return len;
+}
+
+char* vTermCaptureReadScreen( char* CaptureFile, int Command_Seq) {
+
+    FILE* stream;
+
+    char* l_input = NULL;
+    char* l_screen = NULL;
+    char* l_text;
+
+    char** l_rows = NULL;
+
+    size_t l_input_size = 0;
+    size_t l_rows_size = 0;
+    size_t l_screen_size = 0;
+
+    bool l_found = false;
+
+    int l_from = 0;
+    int l_to = 0;
+    int l_len;
+    int l_num;
+    int l_rows_count = 0;
+    int l_state = 0;
+    int row;
+
+    /* Replays the full screens and row deltas of a capture file up to the screen holding Command_Seq. */
+    stream = fopen(CaptureFile, "r");
+
+    if (stream == NULL) {
+        return NULL;
+    }
+
+    while (l_found != true && vTermCaptureReadLine(stream, &l_input, &l_input_size) >= 0) {
+
+        if (l_state == 1) {
+
+            if (strcmp(l_input, "</screen>") == 0) {
+
+                l_state = 0;
+
+                l_found = (Command_Seq >= l_from && Command_Seq <= l_to);
+            }
+            else {
+
+                sgrowarray(l_rows, l_rows_size, l_rows_count);
+
+                l_rows[l_rows_count++] = dupstr(l_input);
+            }
+        }
+        else if (l_state == 2) {
+
+            if (strcmp(l_input, "</screen_delta>") == 0) {
+
+                l_state = 0;
+
+                l_found = (Command_Seq >= l_from && Command_Seq <= l_to);
+            }
+            else if (sscanf(l_input, "<screen_rows>%d</screen_rows>", &l_num) == 1) {
+
+                for (row = l_num; row < l_rows_count; row++) {
+                    sfree(l_rows[row]);
+                }
+
+                sgrowarray(l_rows, l_rows_size, l_num);
+
+                for (row = l_rows_count; row < l_num; row++) {
+                    l_rows[row] = dupstr("");
+                }
+
+                l_rows_count = l_num;
+            }
+            else if (sscanf(l_input, "<screen_row>%d|", &row) == 1 && row >= 0 && row < l_rows_count) {
+
+                l_text = strchr(l_input, '|') + 1;
+
+                l_len = strlen(l_text) - strlen("</screen_row>");
+
+                if (l_len >= 0) l_text[l_len] = '\0';
+
+                sfree(l_rows[row]);
+
+                l_rows[row] = dupstr(l_text);
+            }
+        }
+        else if (sscanf(l_input, "<commands_processed_screen>%d%*c%d", &l_from, &l_to) == 2) {
+            /* Range of commands the next screen belongs to. */
+        }
+        else if (strcmp(l_input, "<screen>") == 0) {
+
+            for (row = 0; row < l_rows_count; row++) {
+                sfree(l_rows[row]);
+            }
+
+            l_rows_count = 0;
+
+            l_state = 1;
+        }
+        else if (strcmp(l_input, "<screen_delta>") == 0) {
+            l_state = 2;
+        }
+    }
+
+    fclose(stream);
+
+    if (l_found == true) {
+
+        l_len = 0;
+
+        for (row = 0; row < l_rows_count; row++) {
+
+            sgrowarray(l_screen, l_screen_size, l_len + strlen(l_rows[row]) + 1);
+
+            memcpy(l_screen + l_len, l_rows[row], strlen(l_rows[row]));
+
+            l_len = l_len + strlen(l_rows[row]);
+
+            if (row < l_rows_count - 1) l_screen[l_len++] = '\n';
+        }
+
+        sgrowarray(l_screen, l_screen_size, l_len);
+
+        l_screen[l_len] = '\0';
+    }
+
+    for (row = 0; row < l_rows_count; row++) {
+        sfree(l_rows[row]);
+    }
+
+    sfree(l_rows);
+    sfree(l_input);
+
+    return l_screen;
+}
+
+/* '-capturescreen <capture file>,<command seq>': writes the screen that command left, rebuilt from the capture file, to '<capture file>.<command seq>.screen' and exits. */
+void vTermCaptureExportScreen( char* Value) {
+
+    FILE* stream;
+
+    char* l_file;
+    char* l_screen;
+    char* l_seq;
+
+    l_file = dupstr(Value);
+
+    l_seq = strrchr(l_file, ',');
+
+    if (l_seq == NULL || isnumeric(l_seq + 1) != true || atoi(l_seq + 1) <= 0) {
+
+        MessageBox(NULL, dupprintf("Fatal Error : 'capturescreen' expects '<capture file>,<command seq>', not '%s' - exiting program.", Value), "Putty Driver", MB_ICONERROR | MB_OK);
+
+        exit(EXIT_FAILURE);
+    }
+
+    *l_seq++ = '\0';
+
+    l_screen = vTermCaptureReadScreen(l_file, atoi(l_seq));
+
+    if (l_screen == NULL) {
+
+        MessageBox(NULL, dupprintf("Fatal Error : No screen for command %s in Capture File '%s' - exiting program.", l_seq, l_file), "Putty Driver", MB_ICONERROR | MB_OK);
+
+        exit(EXIT_FAILURE);
+    }
+
+    stream = fopen(dupprintf("%s.%s.screen", l_file, l_seq), "w");
+
+    if (stream == NULL) {
+
+        MessageBox(NULL, dupprintf("Fatal Error : Cannot create Screen File '%s.%s.screen' - exiting program.", l_file, l_seq), "Putty Driver", MB_ICONERROR | MB_OK);
+
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stream, "%s\n", l_screen);
+
+    fclose(stream);
+
+    sfree(l_screen);
+    sfree(l_file);
+
+    exit(EXIT_SUCCESS);
+}
+
+void vTermWriteSessionToFile() {
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog("vTermWriteSessionToFile|Start", NULL, NULL);
+    }
+
+    if (vterm_nocapture != true) {
+
+        if (vTermCapture_Stream == NULL) {
+
+            MessageBox(NULL, dupprintf("Fatal Error : Session commands file '%s' create failed - exiting program.", vterm_capture_file), "Putty Driver", MB_ICONERROR | MB_OK);
+
+            exit(EXIT_FAILURE);
+        }
+
+        if (vTerm.Screen_Command_Seq_From <= 1 && vTerm.Command_Pass == 0) {
+
+            fprintf(vTermCapture_Stream, dupprintf("<server_hostname>%s</server_hostname>\n", vterm_hostname));
+            fprintf(vTermCapture_Stream, dupprintf("<server_ip>%s</server_ip>\n", vterm_host_ip));
+            fprintf(vTermCapture_Stream, dupprintf("<server_conntype>%s</server_conntype>\n", vterm_host_conntype));
+            fprintf(vTermCapture_Stream, dupprintf("<server_connport>%d</server_connport>\n", vterm_host_connport));
+            fprintf(vTermCapture_Stream, dupprintf("<script>%s</script>\n", vterm_script_file));
+            /* fprintf(vTermCapture_Stream, dupprintf("<stack_space>%llu</stack_space>\n", getavailablestackspace())); */
+            fprintf(vTermCapture_Stream, dupprintf("<process_start>%s</process_start>\n", vTerm.SessionTimeStamp));
+
+        }
+
+        fprintf(vTermCapture_Stream, "%s\n", vTerm.Commands_Processed);
+
+        if (vTerm.Screen_Capture_Pending == true) {
+
+            if (vTermDataset_Columns_Count > 0)
+                fprintf(vTermCapture_Stream, "<commands_processed_screen>%d%c%d%c%ld%c</commands_processed_screen>\n", vTerm.Screen_Capture_Command_Seq_From, DBDelimiter, vTerm.Screen_Command_Seq_To, DBDelimiter, vTerm.Screen_Dataset_Row, DBDelimiter);
+            else
+                fprintf(vTermCapture_Stream, "<commands_processed_screen>%d%c%d%c</commands_processed_screen>\n", vTerm.Screen_Capture_Command_Seq_From, DBDelimiter, vTerm.Screen_Command_Seq_To, DBDelimiter);
+
+            vTerm.Screen_Capture_Command_Seq_From = vTerm.Screen_Command_Seq_To + 1;
+
+            vTermScreenUnshare(true);
+
+            if (vterm_capture_delta > 0)
+                vTermCaptureWriteScreen(rtrim(string_replacechar(vTerm.Screen, '\r', ' ')));
+            else
+                fprintf(vTermCapture_Stream, "<screen>\n%s\n</screen>\n", rtrim(string_replacechar(vTerm.Screen, '\r', ' ')));
+        }
+
+        if (vTermDataset_Stream == NULL) {
+            fflush(vTermCapture_Stream);
+        }
+
+        if (vTermCaptureInputs_Stream != NULL) {
+
+            if (vTerm.Screen_Command_Seq_From <= 1 && vTerm.Command_Pass == 0) {
+                fprintf(vTermCaptureInputs_Stream, dupprintf("0|%s|%s|%s||%s|%s|%d|||||\n", ifnull(vterm_script_file, "New Script"), string_replacechar(dupstr(vterm_hostname), '.', '_'), vterm_hostname, vterm_host_ip, vterm_host_conntype, vterm_host_connport));
+            }
+
+            fprintf(vTermCaptureInputs_Stream, "%s\n", rtrim(string_replacechar(vTerm.Commands_Input, '\r', ' ')));
+
+            if (vTermDataset_Stream == NULL) {
+                fflush(vTermCaptureInputs_Stream);
+            }
+        }
+    }
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog("vTermWriteSessionToFile|Finish", NULL, NULL);
+    }
+}
+
+void vTermCloseSessionLogs() {
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog("vTermCloseSessionLogs", NULL, NULL);
+    }
+
+    vTermSessionTimeStamp();
+
+    if (vTermCapture_Stream != NULL) {
+
+        vTermWriteSessionToFile();
+
+        if (vTermCaptureInputs_Stream != NULL) {
+
+            fflush(vTermCaptureInputs_Stream);
+
+            fclose(vTermCaptureInputs_Stream);
+
+            vTermCaptureInputs_Stream = NULL;
+
+        }
+
+        fprintf(vTermCapture_Stream, dupprintf("<process_finish>%s</process_finish>\n", vTerm.SessionTimeStamp));
+
+        fprintf(vTermCapture_Stream, "</events_log>\n");
+
+        fflush(vTermCapture_Stream);
+
+        fclose(vTermCapture_Stream);
+
+        vTermCapture_Stream = NULL;
+    }
+
+    if (vTermLog_Stream != NULL) {
+
+        if (vTerm.Command_Seq_Max > 0) {
+            fprintf(vTermLog_Stream, "%d|%s|Processed %d of %d Commands\n", vTerm.Session_ID, vTerm.SessionTimeStamp, vTerm.Screen_Command_Seq_To, vTerm.Command_Seq_Max);
+        }
+        else {
+            fprintf(vTermLog_Stream, "%d|%s|Processed %d Commands\n", vTerm.Session_ID, vTerm.SessionTimeStamp, vTerm.Screen_Command_Seq_To);
+        }
+
+        if (vTermDataset_Row_Num > 0) {
+            fprintf(vTermLog_Stream, "%d|%s|Processed %ld Dataset Rows from '%s'\n", vTerm.Session_ID, vTerm.SessionTimeStamp, vTermDataset_Row_Num, vterm_dataset_file);
+        }
+
+        fclose(vTermLog_Stream);
+
+        vTermLog_Stream = NULL;
+    }
+}
+
+void vTermSessionSetValue( char* Command_Value, int Command_Pos, int Command_Seq) {
+
+    if (Command_Seq <= 0) {
+        Command_Seq = vTerm.Command_Seq;
+    }
+
+    if (Command_Pos >= vTerm_DBRecord_Session_Cmd_ID_pos) {
+        Command_Pos = Command_Pos + vTerm.Screen_Capture_Offset;
+    }
+    else {
+
+        vTermCommand* l_cmd = vTermCommandAt(Command_Seq);
+
+        l_cmd->Field[Command_Pos] = vTermIntern(Command_Value);
+
+        vTermCommandCompile(l_cmd);
+    }
+}
+
+void vTermScreenRowInfoSet( vTermScreenRowInfo* Info, const char* Text, int Len) {
+
+    Info->Len = Len;
+    Info->Cols = vTermUtf8Col(Text, Len);
+    Info->Block = -1;
+
+    Info->First = 0;
+
+    while (Info->First < Len && isspace((unsigned char)Text[Info->First])) {
+        Info->First++;
+    }
+
+    Info->Last = Len - 1;
+
+    while (Info->Last >= Info->First && isspace((unsigned char)Text[Info->Last])) {
+        Info->Last--;
+    }
+
+    Info->Blank = (Info->Last < Info->First);
+
+    if (Info->Blank) {
+
+        Info->First = 0;
+        Info->Last = -1;
+    }
+
+    Info->Hash = vTermScreenRowHash(Text, Info->Last + 1);
+}
+
+int vTermScreenRowByte( vTermScreenRowInfo* Info, const char* Text, int Col) {
+
+    /* Byte offset of a screen cell, from the cell map of the row buffer (a wide character covers two cells). */
+    if (Info->Block < 0) {
+        return vTermUtf8Byte(Text, Info->Len, Col);
+    }
+
+    if (Col >= Info->Cols) {
+        return Info->Len + Col - Info->Cols;
+    }
+
+    return (Col < 0 ? 0 : vTerm.Screen_Array_Block_Cell[Info->Block][Col]);
+}
+
+int vTermScreenRowCol( vTermScreenRowInfo* Info, const char* Text, int Byte) {
+
+    int col;
+
+    if (Info->Block < 0) {
+        return vTermUtf8Col(Text, Byte);
+    }
+
+    for (col = 0; col < Info->Cols && vTerm.Screen_Array_Block_Cell[Info->Block][col] < Byte; col++);
+
+    return col;
+}
+
+bool vTermScreenRowContains( int New_Row, int Row) {
+
+    vTermScreenRowInfo* l_new = &vTerm.Screen_New_Array_Info[New_Row];
+    vTermScreenRowInfo* l_row = &vTerm.Screen_Array_Info[Row];
+
+    /* A row that has only scrolled has the same hash, so only rows that differ need searching. */
+    if (l_new->Last == l_row->Last && l_new->Hash == l_row->Hash) {
+        return true;
+    }
+
+    return (vTermMemFind(vTerm.Screen_New_Array[New_Row], l_new->Len, vTerm.Screen_Array[Row], l_row->Last + 1, 0) >= 0);
+}
+
+int vTermScreenRowTrimLen( vTermScreenRowInfo* Info) {
+
+    /* Same as 'strlen(trim(row))', without changing the row. */
+    return (Info->Blank ? 0 : Info->Last - Info->First + 1);
+}
+
+int vTermScreenWrapAdjust( int Screen_Row) {
+
+    int adjust;
+    int len;
+    int row;
+
+    if (Screen_Row <= 0 || vTerm.Screen_Array_Size <= 0) {
+        return 0;
+    }
+
+    if (Screen_Row > vTerm.Screen_Array_Size - 1) {
+        Screen_Row = vTerm.Screen_Array_Size - 1;
+    }
+
+    if (vTerm.Screen_Array_Wrap_Cols != vTerm.Screen_Columns_X) {
+
+        vTerm.Screen_Array_Wrap_Cols = vTerm.Screen_Columns_X;
+
+        vTerm.Screen_Array_Wrap_Rows = 0;
+    }
+
+    /* .Screen_Array_Wrap holds the running total of wrapped rows (rows 1 to n), kept up to date from the first changed row. */
+    for (row = vTerm.Screen_Array_Wrap_Rows; row <= Screen_Row; row++) {
+
+        adjust = 0;
+
+        if (row > 0) {
+
+            adjust = vTerm.Screen_Array_Wrap[row - 1];
+
+            len = vTerm.Screen_Array_Info[row].Cols;
+
+            if (vTerm.Screen_Columns_X > 0 && len > vTerm.Screen_Columns_X) {
+                adjust = adjust + len / vTerm.Screen_Columns_X;
+            }
+        }
+
+        vTerm.Screen_Array_Wrap[row] = adjust;
+    }
+
+    if (vTerm.Screen_Array_Wrap_Rows < Screen_Row + 1) {
+        vTerm.Screen_Array_Wrap_Rows = Screen_Row + 1;
+    }
+
+    return vTerm.Screen_Array_Wrap[Screen_Row];
+}
+
+vTermScreenFind* vTermScreenFindText( char* ScreenText) {
+
+    vTermScreenFind* find;
+
+    int i;
+
+    for (i = 0; i < vTerm_Screen_Find_Max; i++) {
+
+        if (vTermScreenFinds[i].Text[0] != '\0' && strcmp(vTermScreenFinds[i].Text, ScreenText) == 0) {
+            return &vTermScreenFinds[i];
+        }
+    }
+
+    find = &vTermScreenFinds[vTermScreenFinds_Next];
+
+    vTermScreenFinds_Next = (vTermScreenFinds_Next + 1) % vTerm_Screen_Find_Max;
+
+    strncpy(find->Text, ScreenText, MAX_STRING_LENGTH - 1);
+
+    find->Text[MAX_STRING_LENGTH - 1] = '\0';
+
+    /* No row generation matches, so every row is searched on first use. */
+    memset(find->Row_Gen, 0xFF, vTerm.Screen_Array_Size * sizeof(unsigned long));
+
+    return find;
+}
+
+int vTermScreenFindCol( vTermScreenFind* find, int row) {
+
+    /* Only rows copied into .Screen_Array since the last search are searched again. */
+    if (find->Row_Gen[row] != vTerm.Screen_Array_Gen[row]) {
+
+        find->Col[row] = instr(vTerm.Screen_Array[row], find->Text, 0);
+
+        find->Row_Gen[row] = vTerm.Screen_Array_Gen[row];
+    }
+
+    return find->Col[row];
+}
+
+char* vTermScreenTextPosition( char* ScreenText, bool CursorPos) {
+
+    static char vTermScreenTextPositionRet[MAX_STRING_LENGTH];
+
+    vTermScreenFind* find = NULL;
+
+    int pattern;
+    int pos;
+    int row;
+    int row_adj;
+
+    vTermScreenText_Pos_X = -1;
+    vTermScreenText_Pos_Y = -1;
+
+    memset(vTermScreenTextPositionRet,0, MAX_STRING_LENGTH);
+
+    /* Script identifiers and prompts come from the compiled matcher, anything else from the per-row search cache. */
+    pattern = vTermMatchPatternID(ScreenText);
+
+    if (pattern < 0) {
+        find = vTermScreenFindText(ScreenText);
+    }
+
+    /* Start from the last populated row. */
+    row = vTerm.Screen_Array_Last;
+
+    if (row > vTerm.Screen_Array_Size - 1) {
+        row = vTerm.Screen_Array_Size - 1;
+    }
+
+    while (row >= 0) {
+
+        pos = (pattern >= 0 ? vTermMatchRowCol(pattern, row) : vTermScreenFindCol(find, row));
+
+        if (pos >= 0) {
+
+            row_adj = vTermScreenWrapAdjust(row - 1);
+
+            if (!CursorPos || row + row_adj == vTerm.Screen_Cursor.Y) {
+
+                pos = vTermScreenRowCol(&vTerm.Screen_Array_Info[row], vTerm.Screen_Array[row], pos);
+
+                sprintf(vTermScreenTextPositionRet, "%d,%d", row + row_adj, pos);
+
+                vTermScreenText_Pos_X = pos;
+                vTermScreenText_Pos_Y = row + row_adj;
+
+                break;
+            }
+        }
+
+        row--;
+    }
+
+    return vTermScreenTextPositionRet;
+}
+
+unsigned long vTermScreenChar(Terminal* term, unsigned long chr) {
+
+    unsigned long uc = chr;
+
+    /* Same character set translation as 'clipme' in terminal.c. */
+    switch (uc & CSET_MASK) {
+      case CSET_LINEDRW:
+        if (!term->rawcnp) {
+            uc = term->ucsdata->unitab_xterm[uc & 0xFF];
+            break;
+        }
+      case CSET_ASCII:
+        uc = term->ucsdata->unitab_line[uc & 0xFF];
+        break;
+      case CSET_SCOACS:
+        uc = term->ucsdata->unitab_scoacs[uc & 0xFF];
+        break;
+    }
+
+    switch (uc & CSET_MASK) {
+      case CSET_ACP:
+        uc = term->ucsdata->unitab_font[uc & 0xFF];
+        break;
+      case CSET_OEMCP:
+        uc = term->ucsdata->unitab_oemcp[uc & 0xFF];
+        break;
+    }
+
+    if (DIRECT_FONT(uc)) {
+        uc = uc & 0xFF;
+    }
+
+    if (uc < ' ' || uc == 0x7F || (uc >= 0x80 && uc < 0xA0)) {
+        return ' ';
+    }
+    else if (uc > 0x10FFFF || (uc >= 0xD800 && uc < 0xE000)) {
+        return '?';
+    }
+
+    return uc;
+}
+
+void vTermScreenAddChar(char ch) {
+
+    sgrowarray(vTerm.Screen_View, vTerm.Screen_View_Size, vTerm.Screen_View_Len);
+
+    vTerm.Screen_View[vTerm.Screen_View_Len] = ch;
+
+    vTerm.Screen_View_Len++;
+}
+
+void vTermScreenReadTermLine(Terminal* term, termline* ldata, vTermScreenLine* line) {
+
+    int col;
+    int end_col;
+
+    end_col = (ldata->cols < term->cols ? ldata->cols : term->cols);
+
+    if (!(ldata->lattr & LATTR_WRAPPED)) {
+
+        while (end_col > 0 && IS_SPACE_CHR(ldata->chars[end_col - 1].chr) && !ldata->chars[end_col - 1].cc_next) {
+            end_col--;
+        }
+    }
+    else {
+
+        if (ldata->trusted) {
+            end_col = (end_col < TRUST_SIGIL_WIDTH ? 0 : end_col - TRUST_SIGIL_WIDTH);
+        }
+
+        if (ldata->lattr & LATTR_WRAPPED2) {
+            end_col--;
+        }
+    }
+
+    line->Len = 0;
+    line->Cols = 0;
+
+    /* UTF-8 text, with the byte offset of each cell alongside it (the right half of a wide character shares its offset). */
+    for (col = 0; col < end_col; col++) {
+
+        sgrowarray(line->Col, line->Col_Size, line->Cols);
+
+        if (ldata->chars[col].chr != UCSWIDE) {
+
+            sgrowarray(line->Text, line->Size, line->Len + 4);
+
+            line->Col[line->Cols] = line->Len;
+
+            line->Len = line->Len + vTermUtf8Encode(vTermScreenChar(term, ldata->chars[col].chr), line->Text + line->Len);
+        }
+        else {
+            line->Col[line->Cols] = (line->Cols > 0 ? line->Col[line->Cols - 1] : line->Len);
+        }
+
+        line->Cols++;
+    }
+
+    line->Populated = (end_col > 0);
+    line->Wrapped = ((ldata->lattr & LATTR_WRAPPED) != 0);
+    line->Read = true;
+    line->Changed = true;
+}
+
+void vTermScreenReadLine(Terminal* term, int row, vTermScreenLine* line) {
+
+    termline* ldata;
+
+    ldata = term_get_line(term, row);
+
+    vTermScreenReadTermLine(term, ldata, line);
+
+    term_release_line(ldata);
+}
+
+char* vTermWatchTextPosition( char* ScreenText) {
+
+    static char vTermWatchTextPositionRet[MAX_STRING_LENGTH];
+
+    Terminal* term = vTerm.Term;
+
+    vTermScreenWatch* watch = &vTermCommandAt(vTerm.Command_Seq)->Watch;
+    vTermScreenWatchRect* rect;
+
+    termline* ldata;
+
+    int col;
+    int end_col;
+    int i;
+    int len;
+    int pos;
+    int row;
+
+    vTermScreenText_Pos_X = -1;
+    vTermScreenText_Pos_Y = -1;
+
+    vTermWatchTextPositionRet[0] = '\0';
+
+    len = strlen(ScreenText);
+
+    if (term == NULL || len <= 0) {
+        return vTermWatchTextPositionRet;
+    }
+
+    /* Only the watched cells are read, straight from the terminal, in the order the rectangles are declared. */
+    for (i = 0; i < watch->Count; i++) {
+
+        rect = &watch->Rect[i];
+
+        for (row = rect->Row; row < rect->Row + rect->Rows && row < term->rows; row++) {
+
+            ldata = term_get_line(term, row);
+
+            end_col = (rect->Cols < 0 ? term->cols : rect->Col + rect->Cols);
+
+            if (end_col > term->cols) end_col = term->cols;
+            if (end_col > ldata->cols) end_col = ldata->cols;
+
+            vTermWatchLine.Len = 0;
+            vTermWatchLine.Cols = 0;
+
+            for (col = rect->Col; col < end_col; col++) {
+
+                if (ldata->chars[col].chr != UCSWIDE) {
+
+                    sgrowarray(vTermWatchLine.Text, vTermWatchLine.Size, vTermWatchLine.Len + 4);
+                    sgrowarray(vTermWatchLine.Col, vTermWatchLine.Col_Size, vTermWatchLine.Cols);
+                    sgrowarray(vTermWatchCells, vTermWatchCells_Size, vTermWatchLine.Cols);
+
+                    vTermWatchLine.Col[vTermWatchLine.Cols] = vTermWatchLine.Len;
+                    vTermWatchCells[vTermWatchLine.Cols] = col;
+
+                    vTermWatchLine.Len = vTermWatchLine.Len + vTermUtf8Encode(vTermScreenChar(term, ldata->chars[col].chr), vTermWatchLine.Text + vTermWatchLine.Len);
+
+                    vTermWatchLine.Cols++;
+                }
+            }
+
+            term_release_line(ldata);
+
+            pos = vTermMemFind(vTermWatchLine.Text, vTermWatchLine.Len, ScreenText, len, 0);
+
+            if (pos >= 0) {
+
+                for (col = 0; col < vTermWatchLine.Cols && vTermWatchLine.Col[col] < pos; col++);
+
+                vTermScreenText_Pos_X = (col < vTermWatchLine.Cols ? vTermWatchCells[col] : end_col);
+                vTermScreenText_Pos_Y = row;
+
+                sprintf(vTermWatchTextPositionRet, "%d,%d", vTermScreenText_Pos_Y, vTermScreenText_Pos_X);
+
+                return vTermWatchTextPositionRet;
+            }
+        }
+    }
+
+    return vTermWatchTextPositionRet;
+}
+
+bool vTermWatchRowFresh( int Row) {
+
+    /* A watched row counts only if terminal.c has changed it since the last keys were sent. */
+    return (Row >= 0 && (size_t)Row < vterm_row_gen_size && (long)(vterm_row_gen[Row] - vTerm.Command_Send_Gen) > 0);
+}
+
+void vTermScrollbackAdd(Terminal* term, termline* ldata) {
+
+    vTermScreenLine* l_lines;
+
+    int l_size;
+    int i;
+
+    l_size = term->rows + (vterm_screen_history < 0 ? vTerm_Screen_History : vterm_screen_history);
+
+    /* Room for a full screen of lines plus the screen history, kept oldest first when it grows. */
+    if (l_size > vTermScrollback_Size) {
+
+        l_lines = snewn(l_size, vTermScreenLine);
+
+        memset(l_lines, 0, l_size * sizeof(vTermScreenLine));
+
+        for (i = 0; i < vTermScrollback_Size; i++) {
+            l_lines[i] = vTermScrollback[(vTermScrollback_Head + i) % vTermScrollback_Size];
+        }
+
+        if (vTermScrollback != NULL) {
+            sfree(vTermScrollback);
+        }
+
+        vTermScrollback = l_lines;
+        vTermScrollback_Size = l_size;
+        vTermScrollback_Head = 0;
+    }
+
+    if (vTermScrollback_Count == vTermScrollback_Size) {
+
+        vTermScrollback_Head = (vTermScrollback_Head + 1) % vTermScrollback_Size;
+        vTermScrollback_Count--;
+    }
+
+    vTermScreenReadTermLine(term, ldata, &vTermScrollback[(vTermScrollback_Head + vTermScrollback_Count) % vTermScrollback_Size]);
+
+    vTermScrollback_Count++;
+    vTermScrollback_Total++;
+}
+
+bool vTermScrollbackScreen() {
+
+    vTermScreenLine* line;
+
+    size_t l_len;
+
+    unsigned long l_lines;
+    unsigned long i;
+
+    l_lines = vTermScrollback_Total - vTermScrollback_Mark;
+
+    /* Nothing has scrolled off since the last screen, or the ring no longer holds all of it. */
+    if (l_lines == 0 || l_lines > (unsigned long)vTermScrollback_Count) return false;
+
+    vTermScreenUnshare(false);
+
+    l_len = vTerm.Screen_New_Len + 1;
+
+    for (i = vTermScrollback_Count - l_lines; i < (unsigned long)vTermScrollback_Count; i++) {
+        l_len = l_len + vTermScrollback[(vTermScrollback_Head + i) % vTermScrollback_Size].Len + 2;
+    }
+
+    sgrowarray(vTerm.Screen, vTerm.Screen_Size, l_len);
+
+    /* The lines that scrolled off the screen, in the same layout as the screen, followed by the new screen. */
+    l_len = 0;
+
+    for (i = vTermScrollback_Count - l_lines; i < (unsigned long)vTermScrollback_Count; i++) {
+
+        line = &vTermScrollback[(vTermScrollback_Head + i) % vTermScrollback_Size];
+
+        memcpy(vTerm.Screen + l_len, line->Text, line->Len);
+
+        l_len = l_len + line->Len;
+
+        if (!line->Wrapped) {
+
+            vTerm.Screen[l_len++] = '\r';
+            vTerm.Screen[l_len++] = '\n';
+        }
+    }
+
+    memcpy(vTerm.Screen + l_len, vTerm.Screen_New, vTerm.Screen_New_Len + 1);
+
+    vTerm.Screen_Gen++;
+
+    return true;
+}
+
+void vTermScreenResize( int Rows, int Cols) {
+
+    int l_rows;
+    int i;
+
+    if (vterm_screen_history < 0) {
+        vterm_screen_history = vTerm_Screen_History;
+    }
+
+    /* Room for the terminal rows plus the screen history, so most resizes do not need to reallocate. */
+    if (Rows + 1 > vTerm.Screen_Array_Size) {
+
+        l_rows = Rows + 1 + vterm_screen_history;
+
+        /* Two buffers per row, .Screen_Array and .Screen_New_Array share one until the new row changes. Each buffer grows to fit its row, with a cell map alongside it. */
+        vTerm.Screen_Array = sresize(vTerm.Screen_Array, l_rows, char*);
+        vTerm.Screen_New_Array = sresize(vTerm.Screen_New_Array, l_rows, char*);
+
+        vTerm.Screen_Array_Block = sresize(vTerm.Screen_Array_Block, l_rows * 2, char*);
+        vTerm.Screen_Array_Block_Size = sresize(vTerm.Screen_Array_Block_Size, l_rows * 2, size_t);
+        vTerm.Screen_Array_Block_Cell = sresize(vTerm.Screen_Array_Block_Cell, l_rows * 2, int*);
+        vTerm.Screen_Array_Block_Cell_Size = sresize(vTerm.Screen_Array_Block_Cell_Size, l_rows * 2, size_t);
+
+        for (i = vTerm.Screen_Array_Size * 2; i < l_rows * 2; i++) {
+
+            vTerm.Screen_Array_Block[i] = snewn(MAX_SCREEN_COLS, char);
+            vTerm.Screen_Array_Block_Size[i] = MAX_SCREEN_COLS;
+
+            memset(vTerm.Screen_Array_Block[i], 0, MAX_SCREEN_COLS);
+
+            vTerm.Screen_Array_Block_Cell[i] = NULL;
+            vTerm.Screen_Array_Block_Cell_Size[i] = 0;
+        }
+
+        for (i = vTerm.Screen_Array_Size; i < l_rows; i++) {
+
+            vTerm.Screen_Array[i] = vTerm.Screen_Array_Block[i * 2];
+            vTerm.Screen_New_Array[i] = vTerm.Screen_Array_Block[i * 2 + 1];
+        }
+
+        vTerm.Screen_Array_Gen = sresize(vTerm.Screen_Array_Gen, l_rows, unsigned long);
+        vTerm.Screen_New_Array_Gen = sresize(vTerm.Screen_New_Array_Gen, l_rows, unsigned long);
+        vTerm.Screen_New_Array_Line = sresize(vTerm.Screen_New_Array_Line, l_rows, int);
+        vTerm.Screen_Array_Wrap = sresize(vTerm.Screen_Array_Wrap, l_rows, int);
+        vTerm.Screen_Array_Info = sresize(vTerm.Screen_Array_Info, l_rows, vTermScreenRowInfo);
+        vTerm.Screen_New_Array_Info = sresize(vTerm.Screen_New_Array_Info, l_rows, vTermScreenRowInfo);
+
+        vTerm.Screen_Array_Wrap_Rows = 0;
+
+        for (i = vTerm.Screen_Array_Size; i < l_rows; i++) {
+
+            vTerm.Screen_Array_Gen[i] = 0;
+            vTerm.Screen_New_Array_Gen[i] = 0;
+            vTerm.Screen_New_Array_Line[i] = 0;
+
+            vTermScreenRowInfoSet(&vTerm.Screen_Array_Info[i], "", 0);
+            vTermScreenRowInfoSet(&vTerm.Screen_New_Array_Info[i], "", 0);
+        }
+
+        vTermMatchRows = sresize(vTermMatchRows, l_rows, vTermMatchRow);
+
+        for (i = vTerm.Screen_Array_Size; i < l_rows; i++) {
+
+            memset(&vTermMatchRows[i], 0, sizeof(vTermMatchRow));
+
+            vTermMatchRows[i].Gen = (unsigned long)-1;
+        }
+
+        for (i = 0; i < vTerm_Screen_Find_Max; i++) {
+
+            vTermScreenFinds[i].Text[0] = '\0';
+
+            vTermScreenFinds[i].Col = sresize(vTermScreenFinds[i].Col, l_rows, int);
+            vTermScreenFinds[i].Row_Gen = sresize(vTermScreenFinds[i].Row_Gen, l_rows, unsigned long);
+        }
+
+        vTerm.Screen_Array_Size = l_rows;
+    }
+
+    if (vTerm.Screen == NULL) {
+
+        sgrowarray(vTerm.Screen, vTerm.Screen_Size, (Rows + vterm_screen_history) * (Cols + 2));
+
+        vTerm.Screen[0] = '\0';
+    }
+
+    if (vTerm.Screen_New == NULL) {
+
+        sgrowarray(vTerm.Screen_New, vTerm.Screen_New_Size, (Rows + vterm_screen_history) * (Cols + 2));
+
+        vTerm.Screen_New[0] = '\0';
+        vTerm.Screen_New_Len = 0;
+    }
+}
+
+int vTermScreenRowSpare( int row) {
+
+    /* The row buffer of the pair that .Screen_Array[row] is not using. */
+    if (vTerm.Screen_Array[row] == vTerm.Screen_Array_Block[row * 2])
+        return row * 2 + 1;
+    else
+        return row * 2;
+}
+
+void vTermScreenNewSize( int Len) {
+
+    /* .Screen_New is about to be overwritten, so stop sharing it with .Screen. */
+    if (vTerm.Screen_New == vTerm.Screen) {
+
+        vTerm.Screen_New = vTerm.Screen_Spare;
+        vTerm.Screen_New_Size = vTerm.Screen_Spare_Size;
+
+        vTerm.Screen_Spare = NULL;
+        vTerm.Screen_Spare_Size = 0;
+    }
+
+    sgrowarray(vTerm.Screen_New, vTerm.Screen_New_Size, Len);
+}
+
+void vTermScreenSwap() {
+
+    if (vTermScrollbackScreen()) return;
+
+    if (vTerm.Screen == vTerm.Screen_New) return;
+
+    /* The new screen becomes the current screen, and the previous buffer is kept for the next update. */
+    if (vTerm.Screen_Spare != NULL) {
+        sfree(vTerm.Screen_Spare);
+    }
+
+    vTerm.Screen_Spare = vTerm.Screen;
+    vTerm.Screen_Spare_Size = vTerm.Screen_Size;
+
+    vTerm.Screen = vTerm.Screen_New;
+    vTerm.Screen_Size = vTerm.Screen_New_Size;
+
+    vTerm.Screen_Gen++;
+}
+
+void vTermScreenSetRow(int row, char* text, int len, int* cells, int cols) {
+
+    int l_block;
+
+    if (vTerm.Screen_New_Array_Info[row].Len == len && vTerm.Screen_New_Array_Info[row].Cols == cols && memcmp(vTerm.Screen_New_Array[row], text, len) == 0) {
+        return;
+    }
+
+    /* The new row always goes in the buffer .Screen_Array[row] is not using, which may move as it grows. */
+    l_block = vTermScreenRowSpare(row);
+
+    sgrowarray(vTerm.Screen_Array_Block[l_block], vTerm.Screen_Array_Block_Size[l_block], len);
+    sgrowarray(vTerm.Screen_Array_Block_Cell[l_block], vTerm.Screen_Array_Block_Cell_Size[l_block], cols);
+
+    vTerm.Screen_New_Array[row] = vTerm.Screen_Array_Block[l_block];
+
+    memcpy(vTerm.Screen_New_Array[row], text, len);
+
+    vTerm.Screen_New_Array[row][len] = '\0';
+
+    if (cols > 0) {
+        memcpy(vTerm.Screen_Array_Block_Cell[l_block], cells, cols * sizeof(int));
+    }
+
+    vTermScreenRowInfoSet(&vTerm.Screen_New_Array_Info[row], text, len);
+
+    vTerm.Screen_New_Array_Info[row].Cols = cols;
+    vTerm.Screen_New_Array_Info[row].Block = l_block;
+
+    vTerm.Screen_New_Array_Gen[row] = vTerm.Screen_New_Array_Gen_Last;
+}
+
+int vTermScreenRead() {
+
+    Terminal* term = vTerm.Term;
+
+    vTermScreenLine* line;
+
+    bool l_changed;
+    int l_cells;
+    int l_col;
+    int l_last;
+    int l_len;
+    int l_line;
+    int l_rows;
+    int row;
+    size_t l_size;
+    unsigned long l_gen;
+
+    if (term == NULL) {
+
+        vTerm.Screen_View_Len = 0;
+
+        return 0;
+    }
+
+    vterm_curs_x = term->curs.x;
+    vterm_curs_y = term->curs.y;
+
+    /* Nothing on the screen has changed since the last read. */
+    if (vTerm.Screen_View_Len > 0 && vTermScreenLines_Gen == vterm_screen_gen && vTermScreenLines_Rows == term->rows && vTermScreenLines_Cols == term->cols) {
+        return vTerm.Screen_View_Len;
+    }
+
+    vTermScreenResize(term->rows, term->cols);
+
+    l_size = vTermScreenLines_Size;
+
+    sgrowarray(vTermScreenLines, vTermScreenLines_Size, term->rows);
+
+    if (vTermScreenLines_Size > l_size) {
+        memset(vTermScreenLines + l_size, 0, (vTermScreenLines_Size - l_size) * sizeof(vTermScreenLine));
+    }
+
+    if (vTermScreenLines_Cols != term->cols) {
+
+        for (row = 0; row < vTermScreenLines_Size; row++) {
+            vTermScreenLines[row].Read = false;
+        }
+
+        vTermScreenLines_Cols = term->cols;
+    }
+
+    vTermScreenLines_Rows = term->rows;
+    vTermScreenLines_Gen = vterm_screen_gen;
+
+    /* Re-read only the rows terminal.c has marked as changed since they were last read. */
+    for (row = 0; row < term->rows; row++) {
+
+        line = &vTermScreenLines[row];
+
+        l_gen = (row < vterm_row_gen_size ? vterm_row_gen[row] : 0);
+
+        if (!line->Read || line->Gen != l_gen) {
+
+            vTermScreenReadLine(term, row, line);
+
+            line->Gen = l_gen;
+        }
+    }
+
+    /* Lay the rows out as 'term_copyall' would have copied them, dropping the blank rows below the last populated row. */
+    vTerm.Screen_View_Len = 0;
+
+    l_last = -1;
+
+    for (row = 0; row < term->rows; row++) {
+
+        line = &vTermScreenLines[row];
+
+        sgrowarray(vTerm.Screen_View, vTerm.Screen_View_Size, vTerm.Screen_View_Len + line->Len + 2);
+
+        memcpy(vTerm.Screen_View + vTerm.Screen_View_Len, line->Text, line->Len);
+
+        vTerm.Screen_View_Len = vTerm.Screen_View_Len + line->Len;
+
+        if (line->Populated) {
+
+            l_last = row;
+
+            l_len = vTerm.Screen_View_Len;
+        }
+
+        if (!line->Wrapped) {
+
+            vTermScreenAddChar('\r');
+            vTermScreenAddChar('\n');
+        }
+    }
+
+    vTerm.Screen_View_Len = (l_last < 0 ? 0 : l_len);
+
+    vTermScreenAddChar('\r');
+    vTermScreenAddChar('\n');
+
+    sgrowarray(vTerm.Screen_View, vTerm.Screen_View_Size, vTerm.Screen_View_Len);
+
+    vTerm.Screen_View[vTerm.Screen_View_Len] = '\0';
+
+    /* Update only the .Screen_New_Array rows built from changed (or moved) screen rows. */
+    vTerm.Screen_New_Array_Gen_Last++;
+
+    l_rows = 0;
+    l_line = 0;
+    l_len = 0;
+    l_cells = 0;
+    l_changed = false;
+
+    for (row = 0; row <= l_last; row++) {
+
+        line = &vTermScreenLines[row];
+
+        if (l_len == 0) {
+            l_line = row;
+        }
+
+        /* The whole logical row, however many bytes its characters take, with the byte offset of each cell. */
+        sgrowarray(vTermScreenRow_Text, vTermScreenRow_Text_Size, l_len + line->Len);
+        sgrowarray(vTermScreenRow_Cell, vTermScreenRow_Cell_Size, l_cells + line->Cols);
+
+        memcpy(vTermScreenRow_Text + l_len, line->Text, line->Len);
+
+        for (l_col = 0; l_col < line->Cols; l_col++) {
+            vTermScreenRow_Cell[l_cells + l_col] = l_len + line->Col[l_col];
+        }
+
+        l_len = l_len + line->Len;
+        l_cells = l_cells + line->Cols;
+
+        l_changed = l_changed || line->Changed;
+
+        line->Changed = false;
+
+        if (!line->Wrapped || row == l_last) {
+
+            if (l_changed || l_rows >= vTerm.Screen_New_Array_Rows || vTerm.Screen_New_Array_Line[l_rows] != l_line || row == l_last) {
+                vTermScreenSetRow(l_rows, vTermScreenRow_Text, l_len, vTermScreenRow_Cell, l_cells);
+            }
+
+            vTerm.Screen_New_Array_Line[l_rows] = l_line;
+
+            l_rows++;
+            l_len = 0;
+            l_cells = 0;
+            l_changed = false;
+        }
+    }
+
+    for (; row < term->rows; row++) {
+        vTermScreenLines[row].Changed = false;
+    }
+
+    if (l_rows == 0) {
+
+        vTermScreenSetRow(0, "", 0, NULL, 0);
+
+        vTerm.Screen_New_Array_Line[0] = 0;
+
+        l_rows = 1;
+    }
+
+    for (row = l_rows; row < vTerm.Screen_New_Array_Rows; row++) {
+
+        if (vTerm.Screen_New_Array[row][0] != '\0') {
+            vTermScreenSetRow(row, "", 0, NULL, 0);
+        }
+    }
+
+    if (vTerm.Screen_New_Array_Rows_Max < vTerm.Screen_New_Array_Rows) {
+        vTerm.Screen_New_Array_Rows_Max = vTerm.Screen_New_Array_Rows;
+    }
+
+    if (vTerm.Screen_New_Array_Rows_Max < l_rows) {
+        vTerm.Screen_New_Array_Rows_Max = l_rows;
+    }
+
+    vTerm.Screen_New_Array_Rows = l_rows;
+
+    vTerm.Screen_New_Array_Last = l_rows - 1;
+
+    while (vTerm.Screen_New_Array_Last >= 0 && vTerm.Screen_New_Array_Info[vTerm.Screen_New_Array_Last].Blank) {
+        vTerm.Screen_New_Array_Last--;
+    }
+
+    return vTerm.Screen_View_Len;
+}
+
+void vTermScreenArrayUpdate() {
+
+    int row;
+
+    /* Share only the rows that have changed since .Screen_Array was last updated. */
+    for (row = 0; row < vTerm.Screen_New_Array_Rows_Max; row++) {
+
+        if (vTerm.Screen_Array_Gen[row] != vTerm.Screen_New_Array_Gen[row]) {
+
+            vTerm.Screen_Array[row] = vTerm.Screen_New_Array[row];
+
+            vTerm.Screen_Array_Gen[row] = vTerm.Screen_New_Array_Gen[row];
+            vTerm.Screen_Array_Info[row] = vTerm.Screen_New_Array_Info[row];
+
+            if (vTerm.Screen_Array_Wrap_Rows > row) {
+                vTerm.Screen_Array_Wrap_Rows = row;
+            }
+        }
+    }
+
+    vTerm.Screen_New_Array_Rows_Max = vTerm.Screen_New_Array_Rows;
+
+    vTerm.Screen_Array_Rows = vTerm.Screen_New_Rows;
+    vTerm.Screen_Array_Last = vTerm.Screen_New_Array_Last;
+
+    vTermScrollback_Mark = vTermScrollback_Total;
+}
+
+void vTermSessionGetScreen( int GetScreen) {
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog( "vTermSessionGetScreen|Start", dupprintf("%s", GetScreen ? "true" : "false"), NULL);
+    }
+
+    if (GetScreen == true) {
+
+        //vTerm.Command_Mismatch = false;
+            
+        vTerm.Screen_Get = true;
+            
+        vTerm.Screen_Requested_Seq = vTerm.Command_Seq;
+
+        vTermScreenRead();
+
+        vTermScreenUpdated(vTerm.Screen_View, vTerm.Screen_View_Len);
+
+    }
+    else if (vTerm.Screen_Get == true) {
+
+        if (vTermLog_Execution == true) {
+            vTermWriteToLog( "Waiting for vTermSessionGetScreen|", dupprintf("%d", vTerm.Hwnd), NULL);
+        }
+    }
+    else if (!(vTerm.Screen_Cursor_Prev_X == vTerm.Screen_Cursor.X && vTerm.Screen_Cursor_Prev_Y == vTerm.Screen_Cursor.Y)) {
+
+        vTerm.Screen_Get = true;
+        vTerm.Screen_Requested_Seq = vTerm.Command_Seq;
+
+        vTermScreenRead();
+
+        vTermScreenUpdated(vTerm.Screen_View, vTerm.Screen_View_Len);
+    }
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog("vTermSessionGetScreen|Finish", dupprintf("%s", GetScreen ? "true" : "false"), NULL);
+    }
+}
+
+int vTermKeyNameFind(char* Name) {
+
+    int l_slot;
+    int l_key;
+
+    if (vTermKeyNames_Size <= 0) {
+        return -1;
+    }
+
+    l_slot = (int)(vTermScreenRowHash(Name, strlen(Name)) & (vTermKeyNames_Size - 1));
+
+    while ((l_key = vTermKeyNames[l_slot]) >= 0) {
+
+        if (strcmp(vTermKeyCodes[l_key].Field[vTerm_KeyName], Name) == 0) {
+            return l_key;
+        }
+
+        l_slot = (l_slot + 1) & (vTermKeyNames_Size - 1);
+    }
+
+    return -1;
+}
+
+int vTermKeyStateGoto(int state, unsigned char ch) {
+
+    int child;
+
+    for (child = vTermKeyStates[state].Child; child >= 0; child = vTermKeyStates[child].Sibling) {
+
+        if (vTermKeyStates[child].Ch == ch) {
+            return child;
+        }
+    }
+
+    return -1;
+}
+
+int vTermKeyStateNew(int parent, unsigned char ch) {
+
+    int state;
+
+    sgrowarray(vTermKeyStates, vTermKeyStates_Size, vTermKeyStates_Count);
+
+    state = vTermKeyStates_Count;
+
+    vTermKeyStates_Count++;
+
+    vTermKeyStates[state].Ch = ch;
+    vTermKeyStates[state].Child = -1;
+    vTermKeyStates[state].Sibling = -1;
+    vTermKeyStates[state].Key = -1;
+
+    if (parent >= 0) {
+
+        vTermKeyStates[state].Sibling = vTermKeyStates[parent].Child;
+
+        vTermKeyStates[parent].Child = state;
+    }
+
+    return state;
+}
+
+/* Name lookup table and ANSI sequence trie over the loaded key codes; the first entry wins, as the old linear scan did. */
+void vTermKeyCodesIndex() {
+
+    char l_seq[2];
+    char* l_ansi;
+
+    int l_key;
+    int l_next;
+    int l_slot;
+    int l_state;
+
+    vTermKeyNames_Size = 16;
+
+    while (vTermKeyNames_Size < vTermKeyCodes_Count * 2) vTermKeyNames_Size *= 2;
+
+    vTermKeyNames = snewn(vTermKeyNames_Size, int);
+
+    for (l_slot = 0; l_slot < vTermKeyNames_Size; l_slot++) vTermKeyNames[l_slot] = -1;
+
+    vTermKeyStates_Count = 0;
+
+    vTermKeyStateNew(-1, 0);
+
+    for (l_key = 0; l_key < vTermKeyCodes_Count; l_key++) {
+
+        if (vTermKeyNameFind(vTermKeyCodes[l_key].Field[vTerm_KeyName]) < 0) {
+
+            l_slot = (int)(vTermScreenRowHash(vTermKeyCodes[l_key].Field[vTerm_KeyName], strlen(vTermKeyCodes[l_key].Field[vTerm_KeyName])) & (vTermKeyNames_Size - 1));
+
+            while (vTermKeyNames[l_slot] >= 0) l_slot = (l_slot + 1) & (vTermKeyNames_Size - 1);
+
+            vTermKeyNames[l_slot] = l_key;
+        }
+
+        l_ansi = vTermKeyCodes[l_key].Field[vTerm_KeyANSI];
+
+        /* A numeric ANSI value is the code of a single key byte. */
+        if (isnumeric(l_ansi) == true) {
+
+            l_seq[0] = (char)atoi(l_ansi);
+            l_seq[1] = '\0';
+
+            l_ansi = l_seq;
+        }
+
+        if (strlen(l_ansi) <= 0) {
+            continue;
+        }
+
+        l_state = 0;
+
+        for (int i = 0; l_ansi[i] != '\0'; i++) {
+
+            l_next = vTermKeyStateGoto(l_state, (unsigned char)l_ansi[i]);
+
+            if (l_next < 0) {
+                l_next = vTermKeyStateNew(l_state, (unsigned char)l_ansi[i]);
+            }
+
+            l_state = l_next;
+        }
+
+        if (vTermKeyStates[l_state].Key < 0) {
+            vTermKeyStates[l_state].Key = l_key;
+        }
+    }
+}
+
+int vTermKeyAnsiFind(char* Seq) {
+
+    int l_state = 0;
+
+    if (vTermKeyStates_Count <= 0) {
+        return -1;
+    }
+
+    for (int i = 0; Seq[i] != '\0' && l_state >= 0; i++) {
+        l_state = vTermKeyStateGoto(l_state, (unsigned char)Seq[i]);
+    }
+
+    return (l_state > 0 ? vTermKeyStates[l_state].Key : -1);
+}
+
+void vTermSubmitKey( char* CmdKey, bool AnsiSeq) {
+
+    int l_ptr;
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog("vTermSubmitKey|Start", CmdKey, NULL);
+    }
+
+    vTerm.Submit_Key_ANSI[0] = '\0';
+    vTerm.Submit_Key_Send[0] = '\0';
+
+    vTerm.Submit_Key_Len = 0;
+
+    vTerm.Command_Processed_Submit_Key[0] = '\0';
+
+    vTerm.Command_Processed_Submit_Key_Len = 0;
+
+    if (strlen(CmdKey) > 0) {
+
+        if (AnsiSeq == true) {
+
+            vTerm.Command_Submit_Key = false;
+
+            l_ptr = vTermKeyAnsiFind(CmdKey);
+
+            if (l_ptr >= 0) {
+
+                vTerm.Command_Submit_Key = true;
+
+                strcpy(vTerm.Command_Processed_Submit_Key, vTermKeyCodes[l_ptr].Field[vTerm_KeyName]);
+
+                vTerm.Command_Processed_Submit_Key_Len = strlen(CmdKey);
+            }
+
+            if (vTerm.Command_Submit_Key == true) {
+
+                if (RecordForScripting == true) {
+
+                    if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
+
+                        vTermSessionSetValue( vTerm.Command_Prompt_Pos, vTerm_Command_Sent_Cursor_At_pos, vTerm.Command_Seq);
+                        vTermSessionSetValue( vTerm.Command_Processed, vTerm_Command_Send_pos, vTerm.Command_Seq);
+                        vTermSessionSetValue( vTerm.Command_Processed_Submit_Key, vTerm_Command_Submit_Key_pos, vTerm.Command_Seq);
+                    }
+                }
+
+                vTerm.Command_Processed_Len = 0;
+
+                vTerm.Command_Processed_Manual_Input[0] = '\0';
+
+                vTerm.Command_Processing_Started = false;
+                vTerm.Command_Processing_Finished = true;
+            }
+        }
+        else {
+
+            strcpy(vTerm.Submit_Key_Send, CmdKey);
+
+            vTerm.Submit_Key_Len = strlen(CmdKey);
+
+            l_ptr = vTermKeyNameFind(CmdKey);
+
+            if (l_ptr >= 0) {
+
+                if (isnumeric(vTermKeyCodes[l_ptr].Field[vTerm_KeyANSI]) == true) {
+
+                    vTerm.Submit_Key_Send[0] = atoi(vTermKeyCodes[l_ptr].Field[vTerm_KeyANSI]);
+                    vTerm.Submit_Key_Send[1] = '\0';
+
+                    strcpy(vTerm.Submit_Key_ANSI, vTerm.Submit_Key_Send);
+                    strcpy(vTerm.Submit_Key_Value, vTerm.Submit_Key_Send);
+
+                    vTerm.Submit_Key_Len = 1;
+
+                }
+                else {
+
+                    memset(vTerm.Submit_Key_ANSI, 0, sizeof(vTerm.Submit_Key_ANSI));
+
+                    strncpy(vTerm.Submit_Key_ANSI, vTermKeyCodes[l_ptr].Field[vTerm_KeyANSI], strlen(vTermKeyCodes[l_ptr].Field[vTerm_KeyANSI]));
+                    strncpy(vTerm.Submit_Key_Value, vTermKeyCodes[l_ptr].Field[vTerm_KeyValue], strlen(vTermKeyCodes[l_ptr].Field[vTerm_KeyValue]));
+
+                    vTerm.Submit_Key_Len = strlen(vTerm.Submit_Key_ANSI);
+                    //vTerm.Submit_Key_Len = strlen(vTerm.Submit_Key_Value);
+
+                }
+            }
+        }
+    }
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog("vTermSubmitKey|Finish", CmdKey, NULL);
+    }
+}
+
+void vTermEchoReset() {
+
+    vTerm.Echo_Matched = 0;
+    vTerm.Echo_State = 0;
+
+    vTermEcho_Fail_Len = 0;
+}
+
+/* The echo to wait for: Command_Processed without trailing spaces, which some hosts do not echo. */
+int vTermEchoLen() {
+
+    int l_len = strlen(vTerm.Command_Processed);
+
+    while (l_len > 0 && vTerm.Command_Processed[l_len - 1] == ' ') l_len--;
+
+    return l_len;
+}
+
+/* Extend the KMP failure table to Len; Command_Processed only grows while a command is typed, so earlier entries still hold. */
+void vTermEchoFailExtend(int Len) {
+
+    int k;
+
+    if (vTermEcho_Fail_Len > Len) vTermEcho_Fail_Len = Len;
+
+    sgrowarray(vTermEcho_Fail, vTermEcho_Fail_Size, Len);
+
+    if (vTermEcho_Fail_Len == 0 && Len > 0) {
+        vTermEcho_Fail[vTermEcho_Fail_Len++] = 0;
+    }
+
+    for (; vTermEcho_Fail_Len < Len; vTermEcho_Fail_Len++) {
+
+        k = vTermEcho_Fail[vTermEcho_Fail_Len - 1];
+
+        while (k > 0 && vTerm.Command_Processed[vTermEcho_Fail_Len] != vTerm.Command_Processed[k]) k = vTermEcho_Fail[k - 1];
+
+        if (vTerm.Command_Processed[vTermEcho_Fail_Len] == vTerm.Command_Processed[k]) k++;
+
+        vTermEcho_Fail[vTermEcho_Fail_Len] = k;
+    }
+}
+
+/* Match the host echo of Command_Processed straight from the term_data bytes, skipping escape sequences and control characters. */
+void vTermEchoFeed(char* PuttyData, int DataLength) {
+
+    unsigned char l_chr;
+
+    int l_len = 0;
+
+    /* Output that arrives before the first key is sent cannot be its echo. */
+    if (vTerm.Command_Processing_Started == true) {
+
+        l_len = vTermEchoLen();
+
+        vTermEchoFailExtend(l_len);
+    }
+
+    for (int i = 0; i < DataLength; i++) {
+
+        l_chr = (unsigned char)PuttyData[i];
+
+        switch (vTerm.Echo_State) {
+
+        case 1:
+            /* ESC seen. */
+            if (l_chr == '[')
+                vTerm.Echo_State = 2;
+            else if (l_chr == ']' || l_chr == 'P' || l_chr == '_' || l_chr == '^' || l_chr == 'X')
+                vTerm.Echo_State = 3;
+            else if (l_chr >= 0x20 && l_chr <= 0x2F)
+                vTerm.Echo_State = 5;
+            else
+                vTerm.Echo_State = 0;
+            break;
+
+        case 2:
+            /* CSI parameters up to the final byte. */
+            if (l_chr >= 0x40 && l_chr <= 0x7E)
+                vTerm.Echo_State = 0;
+            break;
+
+        case 3:
+            /* OSC / DCS string up to BEL or ST. */
+            if (l_chr == 0x07)
+                vTerm.Echo_State = 0;
+            else if (l_chr == 0x1B)
+                vTerm.Echo_State = 4;
+            break;
+
+        case 4:
+            vTerm.Echo_State = (l_chr == '\\' ? 0 : 3);
+            break;
+
+        case 5:
+            /* Character set designator. */
+            vTerm.Echo_State = 0;
+            break;
+
+        default:
+
+            if (l_chr == 0x1B) {
+                vTerm.Echo_State = 1;
+            }
+            else if (l_chr < 0x20 || l_chr == 0x7F) {
+                /* Line editors echo CR, BS etc. around the text; they do not break the match. */
+            }
+            else if (vTerm.Echo_Matched < l_len) {
+
+                /* A complete match is latched; a mismatch falls back to the longest prefix still matched. */
+                while (vTerm.Echo_Matched > 0 && l_chr != (unsigned char)vTerm.Command_Processed[vTerm.Echo_Matched]) {
+                    vTerm.Echo_Matched = vTermEcho_Fail[vTerm.Echo_Matched - 1];
+                }
+
+                if (l_chr == (unsigned char)vTerm.Command_Processed[vTerm.Echo_Matched]) {
+                    vTerm.Echo_Matched += 1;
+                }
+            }
+        }
+    }
+}
+
+bool vTermEchoComplete() {
+
+    int l_len = vTermEchoLen();
+
+    return (l_len > 0 && vTerm.Echo_Matched >= l_len);
+}
+
+char* vTermGetCommand( int commandpos, int isnumber) {
+
+    char* l_value = vTermCommandAt(vTerm.Command_Seq)->Field[commandpos];
+
+    if (isnumber && strlen(l_value) == 0) {
+        return "0";
+    }
+    else {
+        return l_value;
+    }
+
+}
+
+void vTermSetCommand() {
+
+    vTermCommand* l_cmd;
+
+    char* l_send;
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog( "vTermSetCommand|Start", NULL, NULL);
+    }
+
+    if ((vTerm.Command_Seq > 1) && (vTerm.Command_Mismatch == true)) {
+
+        if (vTermLog_Execution == true) {
+            vTermWriteToLog("vTermSetCommand|Return", "Command Mismatch = True", NULL);
+        }
+
+        return;
+    }
+
+    vTerm.Command_Auto = false;
+
+    l_cmd = vTermCommandAt(vTerm.Command_Seq);
+
+    strcpy(vTerm.Command_Screen_Identifier, vTermGetCommand(vTerm_Expected_Screen_Identifier_pos, false));
+
+    vTermDatasetBind(vTerm.Command_Screen_Identifier, MAX_STRING_LENGTH);
+
+    strcpy(vTerm.Command_Screen_Identifier_Pos, vTermGetCommand(vTerm_Expected_Screen_Identifier_At_pos, false));
+
+    strcpy(vTerm.Command_Prompt_Expected, vTermGetCommand(vTerm_Expected_Command_Prompt_pos, false));
+
+    vTermDatasetBind(vTerm.Command_Prompt_Expected, MAX_STRING_LENGTH);
+
+    strcpy(vTerm.Command_Prompt_Expected_Pos, vTermGetCommand(vTerm_Expected_Command_Prompt_At_pos, false));
+
+    strcpy(vTerm.Command_Send_Expected_Cursor, vTermGetCommand(vTerm_Expected_Input_Cursor_At_pos, false));
+
+    /* The text to send has no fixed size, so the buffers for it and the keys sent so far grow to fit it. */
+    l_send = (vTermDatasetBound(l_cmd->Send) < 0 ? l_cmd->Send : vTermDataset_Bound);
+
+    sgrowarray(vTerm.Command_Send, vTerm.Command_Send_Size, strlen(l_send));
+    sgrowarray(vTerm.Command_Sent, vTerm.Command_Sent_Size, strlen(l_send));
+
+    strcpy(vTerm.Command_Send, l_send);
+
+    vTerm.Command_Paste = l_cmd->Paste;
+
+    if (l_cmd->Send_Pause >= 0) vTerm.Command_Send_Pause = l_cmd->Send_Pause;
+
+    vTerm.Command_Timeout = (l_cmd->Timeout > 0 ? l_cmd->Timeout : vTerm_Command_TimeOut * TICKSPERSEC);
+
+    if (l_cmd->Script_DB_ID >= 0) vTerm.Command_Script_DB_ID = l_cmd->Script_DB_ID;
+
+    strcpy(vTerm.Command_Input_Hidden, vTermGetCommand(vTerm_Command_Input_Hidden_pos, false));
+
+    strcpy(vTerm.Screen_Capture, vTermGetCommand(vTerm_Screen_Capture_OnOff_pos, false));
+
+    strcpy(vTerm.Submit_Key, vTermGetCommand(vTerm_Command_Submit_Key_pos, false));
+
+    vTerm.Command_Screen_Identifier_Len = strlen(vTerm.Command_Screen_Identifier);
+
+    vTerm.Command_Screen_Identifier_Pos_Y = l_cmd->Identifier_At.Y;
+    vTerm.Command_Screen_Identifier_Pos_X = l_cmd->Identifier_At.X;
+
+    vTerm.Command_Prompt_OK[0] = '\0';
+
+    vTerm.Command_Prompt_Expected_Len = strlen(vTerm.Command_Prompt_Expected);
+
+    vTerm.Command_Prompt_Expected_Pos_Y = l_cmd->Prompt_At.Y;
+    vTerm.Command_Prompt_Expected_Pos_X = l_cmd->Prompt_At.X;
+
+    vTerm.Command_Send_Expected_Cursor_Y = l_cmd->Cursor_At.Y;
+    vTerm.Command_Send_Expected_Cursor_X = l_cmd->Cursor_At.X;
+
+    vTerm.Screen_Identifier[0] = '\0';
+    vTerm.Screen_Identifier_Pos[0] = '\0';
+
+    vTerm.Command_Prompt[0] = '\0';
+    vTerm.Command_Prompt_Len = 0;
+    vTerm.Command_Prompt_Pos[0] = '\0';
+    vTerm.Command_Prompt_OK[0] = '\0';
+
+    vTerm.Command_Sent[0] = '\0';
+    vTerm.Command_Sent_Len = 0;
+    vTerm.Command_Sent_Cursor_Pos[0] = '\0';
+
+    vTerm.Command_Mismatch = false;
+    vTerm.Command_Mismatch_Type[0] = '\0';
+    vTerm.Command_Mismatch_Pos_Expected[0] = '\0';
+    vTerm.Command_Mismatch_Pos_Actual[0] = '\0';
+
+    vTerm.Command_Processed[0] = '\0';
+    vTerm.Command_Processed_Len = 0;
+    vTerm.Command_Processed_Submit_Key[0] = '\0';
+
+    vTermEchoReset();
+
+    vTerm.Input_Len = 0;
+
+    vTerm.Command_Processing = false;
+    vTerm.Command_Processing_Started = false;
+    vTerm.Command_Processing_Finished = false;
+
+    vTerm.Command_Wait_Until = GETTICKCOUNT() + (vTerm.Command_Send_Pause > 0 ? vTerm.Command_Send_Pause : 0);
+
+    vTerm.Command_Send_At = GETTICKCOUNT();
+
+    vTerm.Command_Deadline = true;
+
+    vTerm.Command_Submit_Key = false;
+
+    vTerm.Command_Send_Len = strlen(vTerm.Command_Send);
+    vTerm.Command_Send_Buffer_Len = vTerm.Command_Send_Len;
+
+    vTerm.Command_Send_Pos = 0;
+
+    vTerm.Submit_Key_ANSI[0] = '\0';
+    vTerm.Submit_Key_Send[0] = '\0';
+    vTerm.Submit_Key_Len = 0;
+
+    vTermSubmitKey( vTerm.Submit_Key, false);
+
+    if (vTerm.Command_Prompt_Expected_Len + vTerm.Command_Send_Buffer_Len + vTerm.Submit_Key_Len > 0) {
+        vTerm.Command_Auto = true;
+    }
+    else {
+        vTerm.Command_Auto = false;
+    }
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog( "vTermSetCommand|Finish", NULL, NULL);
+    }
+}
+
+void vTermCommandMismatch( char* MismatchType, char* Actual_Pos, char* Expected_Pos) {
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog(dupprintf("vTermCommandMismatch - %s|Start", MismatchType), Actual_Pos, Expected_Pos);
+    }
+
+    vTermSessionSetValue( vTerm.Command_Prompt_OK, 0, 0);
+
+    if (vTerm.Screen_Requested_Seq < vTerm.Command_Seq) {
+        vTermSessionGetScreen( false);
+    }
+    else {
+
+        strcpy(vTerm.Command_Mismatch_Type, MismatchType);
+        strcpy(vTerm.Command_Mismatch_Pos_Expected, Expected_Pos);
+        strcpy(vTerm.Command_Mismatch_Pos_Actual, Actual_Pos);
+
+        if (strstr(MismatchType, "Screen Cursor") == NULL) {
+
+            vTermWriteToLog(dupprintf("vTermCommandMismatch|%s", MismatchType), Actual_Pos, Expected_Pos);
+
+            vTerm.Command_Mismatch = true;
+
+            /* Adaptive send mode goes back to one key at a time until the echo is proven again. */
+            if (vterm_send_adaptive == true && SessionsKeyPressSync != true) {
+
+                SessionsKeyPressSync = true;
+
+                vTermWriteToLog("vTermCommandMismatch|Send mode", "keys", NULL);
+            }
+
+            vTermEchoVerified = 0;
+
+        }
+    }
+
+    strcpy(vTerm.Command_Prompt_OK, "No");
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog(dupprintf("vTermCommandMismatch - %s|Finish", MismatchType), Actual_Pos, Expected_Pos);
+    }
+}
+
+/*
+ * Keys go through term_keyinput as typed keys do, in one call rather than a WM_CHAR message per character, so the
+ * script's UTF-8 is converted to the line codepage and local echo and bracketed paste are handled as for the keyboard.
+ * The driver is still only built into the Windows GUI (putty.h hook #1 is inside _WINDOWS): nothing here needs the
+ * window once a Terminal and Ldisc exist, but running under plink is not supported yet.
+ */
+void SendChars(long Hwnd, char* sChars, bool SysKey) {
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog("SendChars|", sChars, NULL);
+    }
+
+    if (SysKey == true) {
+        SendMessage((HWND)Hwnd, WM_KEYDOWN, (WPARAM)toint(sChars), (LPARAM)0L);
+    }
+    else if (vTerm.Term != NULL && vTerm.Term->ldisc != NULL) {
+        term_keyinput(vTerm.Term, CP_UTF8, sChars, strlen(sChars));
+    }
+    else {
+
+        for (int i = 0; sChars[i] != '\0'; i++) {
+            SendMessage((HWND)Hwnd, WM_CHAR, (WPARAM)sChars[i], (LPARAM)0L);
+        }
+    }
+}
+
+bool vTermInputCommandProcessed(char* CalledFrom) {
+
+    bool l_proc;
+
+    int l_found_row;
+    int l_found_col;
+
+    char* l_cmd;
+    int l_cmd_len;
+
+    if ((strcmp(vTerm.Command_Input_Hidden, "Yes") == 0) || (strlen(vTerm.Command_Processed) <= 0)) {
+        return true;
+    }
+
+    l_found_row = vTerm.Command_Sent_Cursor_Y - vTermScreenWrapAdjust(vTerm.Command_Sent_Cursor_Y - 1);
+
+    /* Searched for by length, so the trailing spaces are left off without copying the command. */
+    l_cmd = vTerm.Command_Processed;
+
+    l_cmd_len = strlen(l_cmd);
+
+    while (l_cmd_len > 0 && isspace((unsigned char)l_cmd[l_cmd_len - 1])) l_cmd_len--;
+
+    if (vTermEchoComplete() == true) {
+
+        if (vTermLog_Execution == true) {
+            vTermWriteToLog(dupprintf("vTermInputCommandProcessed #0|%s - Echo", CalledFrom), vTerm.Command_Sent_Cursor_Pos, dupprintf("%d %s", vTerm.Echo_Matched, vTerm.Command_Processed));
+        }
+
+        return true;
+    }
+
+    //l_found_col = instr(vTerm.Screen_Array[l_found_row], rtrim(dupstr(vTerm.Command_Processed)), 0);
+    if (l_found_row < 0 || l_found_row >= vTerm.Screen_Array_Size) {
+        l_found_row = -1;
+    }
+
+    l_found_col = (l_found_row < 0 ? -1 : vTermMemFind(vTerm.Screen_Array[l_found_row], vTerm.Screen_Array_Info[l_found_row].Len, l_cmd, l_cmd_len, vTermScreenRowByte(&vTerm.Screen_Array_Info[l_found_row], vTerm.Screen_Array[l_found_row], vTerm.Command_Sent_Cursor_X)));
+
+    if (l_found_row >= 0 && l_found_col >= 0) {
+
+        if (vTermLog_Execution == true) {
+            vTermWriteToLog(dupprintf("vTermInputCommandProcessed #1|%s", CalledFrom), dupprintf("%s %s", vTerm.Command_Sent_Cursor_Pos, vTerm.Screen_Array[l_found_row]), dupprintf("%d,%d %s", l_found_row, l_found_col, vTerm.Command_Processed));
+        }
+
+        return true;
+    }
+
+    //l_found_col = instr(String_Array[l_found_row], rtrim(dupstr(vTerm.Command_Processed)), 0);
+    l_found_col = (l_found_row < 0 ? -1 : vTermMemFind(vTerm.Screen_New_Array[l_found_row], vTerm.Screen_New_Array_Info[l_found_row].Len, l_cmd, l_cmd_len, vTermScreenRowByte(&vTerm.Screen_New_Array_Info[l_found_row], vTerm.Screen_New_Array[l_found_row], vTerm.Command_Sent_Cursor_X)));
+
+    if (l_found_row >= 0 && l_found_col >= 0) {
+
+        if (vTermLog_Execution == true) {
+            vTermWriteToLog(dupprintf("vTermInputCommandProcessed #2|%s", CalledFrom), dupprintf("%s %s", vTerm.Command_Sent_Cursor_Pos, vTerm.Screen_New_Array[l_found_row]), dupprintf("%d,%d %s", l_found_row, l_found_col, vTerm.Command_Processed));
+        }
+
+        vTermScreenSwap();
+
+        vTerm.Screen_Len = vTerm.Screen_New_Len;
+
+        vTermScreenArrayUpdate();
+
+        vTermSessionSetValue(vTerm.Screen, vTerm_Screen_pos, vTerm.Command_Seq);
+        vTermSessionSetValue(vTerm.Screen_Command_Seq_From, vTerm_Screen_Command_Seq_pos, vTerm.Command_Seq);
+
+        return true;
+    }
+    else if (l_found_row >= 0) {
+
+        if (vTermLog_Execution == true) {
+
+            vTermWriteToLog(dupprintf("vTermInputCommandProcessed #3a|%s - Previous Screen", CalledFrom), dupprintf("%s %s", vTerm.Command_Sent_Cursor_Pos, vTerm.Screen_Array[l_found_row]), dupprintf("%d,%d %s", l_found_row, l_found_col, vTerm.Command_Processed));
+            vTermWriteToLog(dupprintf("vTermInputCommandProcessed #3b|%s - Updated Screen", CalledFrom), dupprintf("%s %s", vTerm.Command_Sent_Cursor_Pos, vTerm.Screen_New_Array[l_found_row]), dupprintf("%d,%d %s", l_found_row, l_found_col, vTerm.Command_Processed));
+        }
+    }
+    else {
+
+        if (vTermLog_Execution == true) {
+
+            vTermWriteToLog(dupprintf("vTermInputCommandProcessed #4a|%s - Previous Screen", CalledFrom), dupprintf("%s %s", vTerm.Command_Sent_Cursor_Pos, vTerm.Screen), dupprintf("-1,-1 %s", vTerm.Command_Processed));
+            vTermWriteToLog(dupprintf("vTermInputCommandProcessed #4b|%s - Updated Screen", CalledFrom), dupprintf("%s %s", vTerm.Command_Sent_Cursor_Pos, vTerm.Screen_New), dupprintf("-1,-1 %s", vTerm.Command_Processed));
+        }
+    }
+
+    return false;
+}
+
+/* Through term_do_paste, so the host gets bracketed paste when it has asked for it and chunked raw input otherwise. */
+void vTermPaste(char* Text) {
+
+    wchar_t* l_wide;
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog("vTermPaste|", Text, NULL);
+    }
+
+    l_wide = dup_mb_to_wc(CP_UTF8, Text);
+
+    term_do_paste(vTerm.Term, l_wide, wcslen(l_wide));
+
+    sfree(l_wide);
+}
+
+/* A paste over 256 characters, or of several lines, goes out a line at a time from term_paste_callback. */
+bool vTermPasting() {
+    return vTerm.Term != NULL && vTerm.Term->paste_len > 0;
+}
+
+void vTermCommandSend( bool FullCommand) {
+
+    bool l_submit;
+
+    char* l_keys;
+
+    int l_char_len;
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog("vTermCommandSend|Start", NULL, NULL);
+    }
+
+    if (vterm_screen_speed > 0 && !vTermTickReached(vTerm.Command_Send_At + vterm_screen_speed)) {
+
+        vTermTimerSchedule(vTerm.Command_Send_At + vterm_screen_speed);
+
+        if (vTermLog_Execution == true) {
+            vTermWriteToLog("vTermCommandSend|Return", "Screen speed pause", NULL);
+        }
+
+        return;
+    }
+
+    l_submit = vTermInputCommandProcessed(dupprintf("vTermCommandSend #1|FullCommand - %s", FullCommand ? "true" : "false"));
+
+    if (!l_submit == true) {
+
+        vTermSessionGetScreen(false);
+
+        if (vTermLog_Execution == true) {
+            vTermWriteToLog("vTermCommandSend|Return", dupprintf("Waiting for command '%s' to process.", vTerm.Command_Processed), NULL);
+        }
+
+        return;
+    }
+
+    l_submit = false;
+
+    if (vTerm.Command_Send_Buffer_Len > 0) {
+
+        if (vTerm.Command_Paste == true && vTerm.Term != NULL) {
+
+            strcpy(vTerm.Command_Sent, vTerm.Command_Send);
+
+            vTerm.Command_Sent_Len = vTerm.Command_Send_Buffer_Len;
+
+            vTerm.Command_Send_Pos = vTerm.Command_Send_Buffer_Len;
+            vTerm.Command_Send_Buffer_Len = 0;
+
+            vTermPaste(vTerm.Command_Send);
+
+            vTerm.Command_Send_At = GETTICKCOUNT();
+            vTerm.Command_Send_Gen = vterm_screen_gen;
+        }
+        else if (FullCommand && SessionsKeyPressSync != true && vTerm.Submit_Key_Len > 0) {
+
+            /* Batch mode: the command and its submit key go out together, so the echo is checked after the submit. */
+            strcpy(vTerm.Command_Sent, vTerm.Command_Send);
+
+            vTerm.Command_Sent_Len = vTerm.Command_Send_Buffer_Len;
+
+            vTerm.Command_Send_Pos = vTerm.Command_Send_Buffer_Len;
+            vTerm.Command_Send_Buffer_Len = 0;
+
+            vTerm.Command_Current_Seq = vTerm.Command_Seq;
+
+            strcpy(vTerm.Command_Prompt, vTerm.Command_Prompt_Expected);
+
+            vTerm.Command_Prompt_Len = vTerm.Command_Prompt_Expected_Len;
+
+            l_keys = dupprintf("%s%s", vTerm.Command_Send, vTerm.Submit_Key_ANSI);
+
+            SendChars(vTerm.Hwnd, l_keys, false);
+
+            sfree(l_keys);
+
+            vTerm.Submit_Key_Len = 0;
+
+            vTerm.Command_Send_At = GETTICKCOUNT();
+            vTerm.Command_Send_Gen = vterm_screen_gen;
+
+            vTerm.Command_Processing = false;
+        }
+        else if (FullCommand || strcmp(vTerm.Command_Input_Hidden, "Yes") == 0) {
+
+            strcpy(vTerm.Command_Sent, vTerm.Command_Send);
+
+            vTerm.Command_Sent_Len = vTerm.Command_Send_Buffer_Len;
+
+            vTerm.Command_Send_Pos = vTerm.Command_Send_Buffer_Len;
+            vTerm.Command_Send_Buffer_Len = 0;
+
+            SendChars(vTerm.Hwnd, vTerm.Command_Send, false);
+
+            vTerm.Command_Send_At = GETTICKCOUNT();
+            vTerm.Command_Send_Gen = vterm_screen_gen;
+        }
+        else {
+
+            /* One key is one character, which may be several UTF-8 bytes. */
+            l_char_len = 1;
+
+            if (((unsigned char)vTerm.Command_Send[vTerm.Command_Send_Pos] & 0xE0) == 0xC0) l_char_len = 2;
+            else if (((unsigned char)vTerm.Command_Send[vTerm.Command_Send_Pos] & 0xF0) == 0xE0) l_char_len = 3;
+            else if (((unsigned char)vTerm.Command_Send[vTerm.Command_Send_Pos] & 0xF8) == 0xF0) l_char_len = 4;
+
+            if (l_char_len > vTerm.Command_Send_Buffer_Len) l_char_len = vTerm.Command_Send_Buffer_Len;
+
+            char chr[5];
+
+            memcpy(chr, &vTerm.Command_Send[vTerm.Command_Send_Pos], l_char_len);
+            chr[l_char_len] = '\0';
+
+            vTerm.Command_Send_Pos += l_char_len;
+
+            strcat(vTerm.Command_Sent, chr);
+
+            vTerm.Command_Sent_Len += l_char_len;
+            vTerm.Command_Send_Buffer_Len -= l_char_len;
+
+            SendChars(vTerm.Hwnd, chr, false);
+
+            vTerm.Command_Send_At = GETTICKCOUNT();
+            vTerm.Command_Send_Gen = vterm_screen_gen;
+        }
+    }
+    else if (vTerm.Submit_Key_Len > 0) {
+
+        /* Typing the submit key mid-paste would have term_nopaste throw the rest of it away. */
+        if (vTermPasting()) {
+
+            vTermTimerSchedule(GETTICKCOUNT() + vTerm_Input_Key_Wait);
+
+            if (vTermLog_Execution == true) {
+                vTermWriteToLog("vTermCommandSend|Return", "Waiting for the paste to finish", NULL);
+            }
+
+            return;
+        }
+
+        vTerm.Command_Current_Seq = vTerm.Command_Seq;
+
+        strcpy(vTerm.Command_Prompt, vTerm.Command_Prompt_Expected);
+
+        vTerm.Command_Prompt_Len = vTerm.Command_Prompt_Expected_Len;
+
+        SendChars(vTerm.Hwnd, vTerm.Submit_Key_ANSI, false);
+        //SendChars(vTerm.Hwnd, vTerm.Submit_Key_Send, true);
+
+        vTerm.Submit_Key_Len = 0;
+
+        vTerm.Command_Send_At = GETTICKCOUNT();
+        vTerm.Command_Send_Gen = vterm_screen_gen;
+
+        /* Every key of this command was echoed back before the submit key was sent. */
+        if (vterm_send_adaptive == true && SessionsKeyPressSync == true && vTerm.Command_Sent_Len > 0 && strlen(vTerm.Command_Processed) > 0 && strcmp(vTerm.Command_Input_Hidden, "Yes") != 0) {
+
+            vTermEchoVerified += 1;
+
+            if (vTermEchoVerified >= vTerm_Echo_Verify_Commands) {
+
+                SessionsKeyPressSync = false;
+
+                if (vTermLog_Execution == true) {
+                    vTermWriteToLog("vTermCommandSend|Send mode", "batch", dupprintf("%d", vTermEchoVerified));
+                }
+            }
+        }
+
+        vTerm.Command_Processing = false;
+    }
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog("vTermCommandSend|Finish", NULL, NULL);
+    }
+}
+
+void vTermSendCommand() {
+
+    int l_screen_pos;
+
+    int l_sid;
+
+    int l_act_X;
+    int l_act_Y;
+
+    int l_exp_X;
+    int l_exp_Y;
+
+    char* l_control;
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog( "vTermSendCommand|", vTerm.Command_Sent, vTerm.Command_Send);
+    }
+
+    if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
+
+        if (vTermLog_Execution == true) {
+            vTermWriteToLog("vTermSendCommand|Return", dupprintf("No data to send - script finished at command %d", vTerm.Command_Seq_Max), NULL);
+        }
+
+        return;
+    }
+
+    if (vTerm.Command_Send_Buffer_Len + vTerm.Submit_Key_Len <= 0) {
+
+        if (vTermLog_Execution == true) {
+            vTermWriteToLog("vTermSendCommand|Return", "No input command set", NULL);
+        }
+
+        return;
+    }
+
+    if (vTerm.Command_Mismatch == true) {
+
+        if (vTermLog_Execution == true) {
+            vTermWriteToLog( "vTermSendCommand|Return", "Command Mismatch = True", NULL);
+        }
+
+        return;
+    }
+
+    if (!vTermTickReached(vTerm.Command_Wait_Until)) {
+
+        vTermTimerSchedule(vTerm.Command_Wait_Until);
+
+        if (vTermLog_Execution == true) {
+            vTermWriteToLog( "vTermSendCommand|Waiting", NULL, vTerm.Command_Send);
+        }
+
+        return;
+    }
+
+    bool l_waiting = vTerm.Command_Wait;
+
+    bool l_watch = false;
+
+    vTerm.Command_Wait = 0;
+
+    bool l_proc = true;
+
+    if (vTerm.Command_Current_Seq < vTerm.Command_Seq && vTerm.Command_Send_Buffer_Len + vTerm.Submit_Key_Len > 0) {
+
+        if (vTerm.Command_Send_Expected_Cursor_Y < 0 || vTerm.Command_Send_Expected_Cursor_Y == vTerm.Screen_Cursor.Y) {
+
+            if (vTerm.Command_Send_Expected_Cursor_X < 0 || 
+                vTerm.Command_Send_Expected_Cursor_X == vTerm.Screen_Cursor.X - vTerm.Command_Send_Pos || 
+                (vTerm.Command_Send_Expected_Cursor_X == vTerm.Screen_Cursor.X && strstr(vTerm.Command_Input_Hidden, "Yes") != NULL)) {
+
+                if ((SessionsKeyPressSync == true && vTermEchoComplete() != true) || vTerm.Command_Send_Pos <= 0 || vTerm.Command_Send_Pos == vTerm.Command_Send_Buffer_Len) {
+                    vTermSessionGetScreen( false);
+                }
+
+                l_proc = true;
+
+                l_watch = (vTermCommandAt(vTerm.Command_Seq)->Watch.Count > 0);
+
+                if (vTerm.Command_Screen_Identifier_Len > 0) {
+
+                    if (l_watch == true)
+                        strcpy(vTerm.Screen_Identifier_Pos, vTermWatchTextPosition(vTerm.Command_Screen_Identifier));
+                    else
+                        strcpy(vTerm.Screen_Identifier_Pos, vTermScreenTextPosition(vTerm.Command_Screen_Identifier, false));
+
+                    if (strlen(vTerm.Screen_Identifier_Pos) > 0 || (l_watch != true && vTermScreenFindFirst(vTerm.Command_Screen_Identifier) >= 0)) {
+
+                        if (strlen(trim(vTerm.Screen_Identifier_Pos)) > 0) {
+
+                            vTermSessionSetValue(vTerm.Screen_Identifier_Pos, vTerm_Screen_Identifier_At_pos, vTerm.Command_Seq);
+
+                            if (vTerm.Command_Screen_Identifier_Pos_Y < 0 || vTerm.Command_Screen_Identifier_Pos_Y == vTermScreenText_Pos_Y) {
+
+                                if (vTerm.Command_Screen_Identifier_Pos_X < 0 || vTerm.Command_Screen_Identifier_Pos_X == vTermScreenText_Pos_X) {
+
+                                    vTermSessionSetValue(vTerm.Screen_Identifier_Pos, vTerm_Screen_Identifier_At_pos, vTerm.Command_Seq);
+
+                                    if (vTermLog_Execution == true) {
+                                        vTermWriteToLog(dupprintf("Screen Identifier '%s' Position Matches OK (expected at %s)", vTerm.Command_Screen_Identifier, vTerm.Command_Screen_Identifier_Pos), vTerm.Screen_Identifier_Pos, vTerm.Command_Screen_Identifier_Pos);
+                                    }
+                                }
+                                else {
+
+                                    l_proc = false;
+
+                                    if (vTermScreenText_Pos_Y >= 0) {
+
+                                        strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Screen Identifier '%s' Position (Y,X) Mismatch (actual %s vs expected %s) (1)", vTerm.Command_Screen_Identifier, vTerm.Screen_Identifier_Pos, vTerm.Command_Screen_Identifier_Pos));
+
+                                        vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+
+                                        vTermCommandMismatch(vTerm.Command_Prompt_OK, vTerm.Screen_Identifier_Pos, vTerm.Command_Screen_Identifier_Pos);
+
+                                    }
+
+                                    vTerm.Screen_Identifier_Pos[0] = '\0';
+                                }
+                            }
+                            else {
+
+                                l_proc = false;
+
+                                if (vTermScreenText_Pos_Y >= 0) {
+
+                                    strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Screen Identifier '%s' Position (Y,X) Mismatch (actual %s vs expected %s) (2)", vTerm.Command_Screen_Identifier, vTerm.Screen_Identifier_Pos, vTerm.Command_Screen_Identifier_Pos));
+
+                                    vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+
+                                    vTermCommandMismatch(vTerm.Command_Prompt_OK, vTerm.Screen_Identifier_Pos, vTerm.Command_Screen_Identifier_Pos);
+                                }
+
+                                vTerm.Screen_Identifier_Pos[0] = '\0';
+                            }
+                        }
+                    }
+                    else {
+
+                        l_proc = false;
+
+                        if (strlen(trim(vTerm.Command_Screen_Identifier_Pos)) > 0)
+                            strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Screen Identifier '%s' Not Found (expected at %s)", vTerm.Command_Screen_Identifier, vTerm.Command_Screen_Identifier_Pos));
+                        else
+                            strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Screen Identifier '%s' Not Found", vTerm.Command_Screen_Identifier));
+
+                        vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+
+                        vTermCommandMismatch(vTerm.Command_Prompt_OK, "", vTerm.Command_Screen_Identifier);
+                    }
+                }
+
+                if ((l_proc == true) && (vTerm.Command_Prompt_Expected_Len > 0)) {
+
+                    vTermScreenUnshare(true);
+
+                    if ((vTerm.Screen_Cursor.X < 0) || (strlen(trim(vTerm.Screen))) <= 0) {
+
+                        if (vTermLog_Execution == true) {
+
+                            if (vTerm.Screen_Cursor.X < 0)
+                                vTermWriteToLog("vTermSendCommand|Screen_Cursor.X < 0", NULL, NULL);
+
+                            if (strlen(trim(vTerm.Screen)) <= 0)
+                                vTermWriteToLog("vTermSendCommand|Screen < 0", NULL, NULL);
+                        }
+
+                        return;
+                    }
+
+                    if (l_watch == true) {
+
+                        strcpy(vTerm.Command_Prompt_Pos, vTermWatchTextPosition(vTerm.Command_Prompt_Expected));
+
+                        /* A prompt left over from before the last send is not the prompt this command waits for. */
+                        l_screen_pos = (strlen(vTerm.Command_Prompt_Pos) > 0 && vTermWatchRowFresh(vTermScreenText_Pos_Y) ? vTerm.Screen_Ptr + 1 : -1);
+                    }
+                    else {
+                        l_screen_pos = vTermScreenFindLast(vTerm.Command_Prompt_Expected);
+                    }
+
+                    if (l_screen_pos < 0 ) {
+
+                        l_proc = false;
+
+                        if (strlen(trim(vTerm.Command_Prompt_Expected_Pos)) > 0)
+                            strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Command Prompt '%s' Not Found (expected at %s)", vTerm.Command_Prompt_Expected, vTerm.Command_Prompt_Expected_Pos));
+                        else
+                            strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Command Prompt '%s' Not Found", vTerm.Command_Prompt_Expected));
+
+                        vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+
+                        vTermCommandMismatch(vTerm.Command_Prompt_OK, "", vTerm.Command_Prompt_Expected);
+
+                    }
+                    else if (l_screen_pos > vTerm.Screen_Ptr) {
+
+                        if (l_watch != true) {
+                            strcpy(vTerm.Command_Prompt_Pos, vTermScreenTextPosition(vTerm.Command_Prompt_Expected, false));
+                        }
+
+                        if (strlen(trim(vTerm.Command_Prompt_Pos)) > 0) {
+                            vTermSessionSetValue( vTerm.Command_Prompt_Pos, vTerm_Command_Prompt_At_pos, vTerm.Command_Seq);
+                        }
+
+                        if (strlen(trim(vTerm.Command_Prompt_Expected_Pos)) > 0) {
+
+                            if (vTerm.Command_Prompt_Expected_Pos_Y < 0 || vTerm.Command_Prompt_Expected_Pos_Y == vTermScreenText_Pos_Y) {
+
+                                if (vTerm.Command_Prompt_Expected_Pos_X < 0 || vTerm.Command_Prompt_Expected_Pos_X == vTermScreenText_Pos_X) {
+
+                                    vTermSessionSetValue(vTerm.Command_Prompt_Pos, vTerm_Command_Prompt_At_pos, vTerm.Command_Seq);
+
+                                    if (vTermLog_Execution == true) {
+                                        vTermWriteToLog(dupprintf("Command Prompt '%s' Position Matches OK (expected at %s)", vTerm.Command_Prompt_Expected, vTerm.Command_Prompt_Expected_Pos), vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
+                                    }
+                                }
+                                else {
+
+                                    l_proc = false;
+
+                                    if (vTermScreenText_Pos_Y >= 0) {
+
+                                        strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Command Prompt '%s' Position (Y,X) Mismatch (actual %s vs expected %s) (1)", vTerm.Command_Prompt_Expected, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos));
+
+                                        vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+
+                                        vTermCommandMismatch(vTerm.Command_Prompt_OK, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
+
+                                    }
+
+                                    vTerm.Command_Prompt_Pos[0] = '\0';
+                                }
+                            }
+                            else {
+
+                                l_proc = false;
+
+                                if (vTermScreenText_Pos_Y >= 0) {
+
+                                    strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Command Prompt '%s' Position (Y,X) Mismatch (actual %s vs expected %s) (2)", vTerm.Command_Prompt_Expected, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos));
+
+                                    vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+
+                                    vTermCommandMismatch(vTerm.Command_Prompt_OK, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
+                                }
+
+                                vTerm.Command_Prompt_Pos[0] = '\0';
+                            }
+                        }
+
+                        if (l_proc == true && l_watch != true) {
+                            vTerm.Screen_Ptr = l_screen_pos;
+                        }
+                    }
+                    else {
+
+                        l_proc = false;
+
+                        if (vTermScreenText_Pos_Y >= 0) {
+
+                            strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Command Prompt '%s' Position (Y,X) Mismatch (actual %s vs expected %s) (3)", vTerm.Command_Prompt_Expected, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos));
+
+                            vTermSessionSetValue( vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+
+                            if (vTerm.Screen_Requested_Seq < vTerm.Command_Seq) {
+                                vTermSessionGetScreen( false);
+                            }
+                            else {
 
-                                    if (vTermScreenText_Pos_Y >= 0) {
+                                vTerm.Command_Mismatch = true;
 
-                                        strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Screen Identifier '%s' Position (Y,X) Mismatch (actual %s vs expected %s) (1)", vTerm.Command_Screen_Identifier, vTerm.Screen_Identifier_Pos, vTerm.Command_Screen_Identifier_Pos));
+                                vTermCommandMismatch(vTerm.Command_Prompt_OK, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
 
-                                        vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+                            }
+                        }
+                    }
+                }
 
-                                        vTermCommandMismatch(vTerm.Command_Prompt_OK, vTerm.Screen_Identifier_Pos, vTerm.Command_Screen_Identifier_Pos);
+                if (l_proc == true) {
 
-                                    }
+                    vTerm.Command_Mismatch = false;
 
-                                    vTerm.Screen_Identifier_Pos[0] = '\0';
-                                }
+                    strcpy(vTerm.Command_Prompt_OK, "Yes");
+
+                    vTermSessionSetValue( vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+
+                    vTerm.Command_Prompt_Expected_Len = -99;
+
+                    if (vTerm.Hwnd > 0 && !(vTerm_Stop == true)) {
+
+                        if (!(vTerm.Command_Wait == true)) {
+                            vTermCommandSend( !SessionsKeyPressSync);
+                        }
+                    }
+                }
+            }
+            else if (vTerm.Screen_Cursor.Y >= 0 && (vTerm.Command_Prompt_Expected_Pos_Y > 0 || vTerm.Command_Prompt_Expected_Pos_X> 0)) {
+
+                if (strlen(vTerm.Command_Prompt_Expected_Pos) <= 0) {
+                    vTerm.Command_Seq = vTerm.Command_Seq;
+                }
+
+                strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Screen Cursor Position (Y,X) Mismatch (actual %s vs expected %s) (4)", ifnull(vTerm.Command_Prompt_Pos, "not found"), vTerm.Command_Prompt_Expected_Pos));
+
+                vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+
+                vTermCommandMismatch(vTerm.Command_Prompt_OK, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
+
+                if (vTermLog_Execution == true) {
+                    vTermWriteToLog( "vTermSendCommand|Cursor X Position (Y,X) Mismatch", dupprintf("%d", (vTerm.Screen_Cursor.X - vTerm.Command_Send_Pos)), dupprintf("%d", vTerm.Command_Send_Expected_Cursor_X));
+                }
+            }
+        }
+        else if (vTerm.Screen_Cursor.Y >= 0 && (vTerm.Command_Prompt_Expected_Pos_Y > 0 || vTerm.Command_Prompt_Expected_Pos_X > 0)) {
+
+            strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Screen Cursor Position (Y,X) Mismatch (actual %s vs expected %s) (5)", ifnull(vTerm.Command_Prompt_Pos, "not found"), vTerm.Command_Prompt_Expected_Pos));
+
+            vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+
+            vTermCommandMismatch(vTerm.Command_Prompt_OK, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
+
+            if (vTermLog_Execution == true) {
+                vTermWriteToLog( "vTermSendCommand|Cursor Y Position (Y,X) Mismatch", dupprintf("%d", vTerm.Screen_Cursor.Y), dupprintf("%d", vTerm.Command_Send_Expected_Cursor_Y));
+            }
+        }
+    }
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog( "vTermSendCommand|Finish", vTerm.Command_Sent, vTerm.Command_Send);
+    }
+}
+
+void vTermSessionInitialise(int SessionID) {
+
+    vTerm.Command_Seq = 1;
+    vTerm.Command_Current_Seq = -1;
+    vTerm.Command_Seq_Max = -1;
+    vTerm.Command_Prompt[0] = '\0';
+    vTerm.Command_Prompt_Pos[0] = '\0';
+    vTerm.Command_Prompt_Len = 0;
+    vTerm.Command_Prompt_OK[0] = '\0';
+
+    sgrowarray(vTerm.Command_Processed, vTerm.Command_Processed_Size, MAX_BUFFER_SIZE);
+    sgrowarray(vTerm.Command_Processed_ASCII, vTerm.Command_Processed_ASCII_Size, MAX_BUFFER_SIZE);
+    sgrowarray(vTerm.Command_Processed_Manual_Input, vTerm.Command_Processed_Manual_Input_Size, MAX_BUFFER_SIZE);
+
+    vTerm.Command_Processed_Manual_Input[0] = '\0';
+    vTerm.Command_Mismatch = false;
+    vTerm.Command_Mismatch_Type[0] = '\0';
+    vTerm.Command_Mismatch_Pos_Expected[0] = '\0';
+    vTerm.Command_Mismatch_Pos_Actual[0] = '\0';
+    vTerm.Command_Processing = false;
+    vTerm.Command_Processing_Started = false;
+    vTerm.Command_Processing_Finished = false;
+    vTerm.Command_Processed_ASCII[0] = '\0';
+    vTerm.Command_Processed[0] = '\0';
+    vTerm.Command_Processed_Len = 0;
+    vTerm.Command_Current_Seq = -1;
+
+    vTerm.Command_Timeout = vTerm_Command_TimeOut * TICKSPERSEC;
+
+    sgrowarray(vTerm.Command_Send, vTerm.Command_Send_Size, MAX_STRING_LENGTH);
+    sgrowarray(vTerm.Command_Sent, vTerm.Command_Sent_Size, MAX_STRING_LENGTH);
+    sgrowarray(vTerm.Commands_Input, vTerm.Commands_Input_Size, MAX_BUFFER_SIZE);
+    sgrowarray(vTerm.Commands_Processed, vTerm.Commands_Processed_Size, MAX_BUFFER_SIZE);
+
+    vTerm.Command_Send[0] = '\0';
+    vTerm.Command_Sent[0] = '\0';
+
+    vTermEchoReset();
+
+    vTerm.Input_Len = 0;
+    vTerm.Command_Screen_Identifier[0] = '\0';
+    vTerm.Command_Screen_Identifier_Len = 0;
+    vTerm.Command_Submit_Key = false;
+    vTerm.Command_Wait = false;
+    vTerm.Commands_Input[0] = '\0';
+    vTerm.Commands_Processed[0] = '\0';
+    vTerm.Controller_Updated_Seq = -1;
+    vTerm.Screen_Capture_Offset = 0;
+    vTerm.Screen_Capture_RGB = 0;
+    vTerm.Screen_Get = false;
+    vTerm.Screen_Ptr = -1;
+    vTerm.Screen_Raw[0] = '\0';
+    vTerm.Screen_Raw_ASCII[0] = '\0';
+    vTerm.Pid = 0L;
+    vTerm.Hwnd = 0L;
+    vTerm.Screen_Command_Seq_From = 1;
+    vTerm.Screen_Capture_Command_Seq_From = 1;
+    vTerm.Command_Pass = 0;
+    vTerm.Screen_Cursor_Prev_X = -1;
+    vTerm.Screen_Cursor_Prev_Y = -1;
+    
+    vTermScreenResize(vTerm.Term->rows, vTerm.Term->cols);
+
+    vTermScreenUnshare(false);
+
+    vTerm.Screen[0] = '\0';
+    vTerm.Screen_Gen++;
+
+    vTermScrollback_Mark = vTermScrollback_Total;
+
+    memset(vTerm.Screen_Array_Gen, 0, vTerm.Screen_Array_Size * sizeof(unsigned long));
+
+    for (int row = 0; row < vTerm.Screen_Array_Size; row++) {
+
+        if (vTerm.Screen_Array[row] == vTerm.Screen_New_Array[row]) {
+            vTerm.Screen_Array[row] = vTerm.Screen_Array_Block[vTermScreenRowSpare(row)];
+        }
+
+        vTerm.Screen_Array[row][0] = '\0';
+
+        vTermScreenRowInfoSet(&vTerm.Screen_Array_Info[row], "", 0);
+    }
+
+    vTerm.Screen_Array_Last = -1;
+
+    vTerm.Screen_Array_Rows = 0;
+    vTerm.Screen_Array_Wrap_Rows = 0;
+    vTerm.Screen_New_Rows = 0;
+
+    vTerm_Stop = false;
+
+    if (strlen(vterm_capture_file) >= 0) {
+        vTermOpenSessionFiles();
+    }
+}
+
+void vTermInputKey(char* Seq, int Seq_Len, bool Last) {
+
+    char l_cmd[MAX_BUFFER_SIZE];
+    int l_cmd_len;
+
+    bool l_alpha;
+    bool l_proc;
+
+    bool l_submit;
+    bool l_submit_key = false;
+
+    int l_ptr;
+
+    int l_scr_len;
+    int l_scr_pos;
+
+    int l_wrap;
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog("vTermInputKey|Start", dupprintf("%d %s", Seq_Len, Seq), vTerm.Command_Processed);
+    }
+
+    /* The prompt scan runs on the first token of a command only; later tokens just check for hidden input. */
+    if (vTerm.Command_Sent_Cursor_Pos[0] != '\0') {
+
+        if (vTerm.Command_Seq > vTerm.Command_Seq_Max && strcmp(vTerm.Command_Input_Hidden, "Yes") != 0) {
+        
+            if (vTerm.Command_Sent_Cursor_Y == vTerm.Screen_Cursor.Y && vTerm.Command_Sent_Cursor_X == vTerm.Screen_Cursor.X) {
+
+                vTermSessionSetValue("Yes", vTerm_Command_Input_Hidden_pos, vTerm.Command_Seq);
+
+                strcpy(vTerm.Command_Input_Hidden, "Yes");
+
+            }
+        }
+    }
+    else {
+
+        vTerm.Command_Sent_Cursor_X = vTerm.Screen_Cursor.X;
+        vTerm.Command_Sent_Cursor_Y = vTerm.Screen_Cursor.Y;
+
+        sprintf(vTerm.Command_Sent_Cursor_Pos, "%d,%d", vTerm.Command_Sent_Cursor_Y, vTerm.Command_Sent_Cursor_X);
+
+        vTermSessionSetValue(vTerm.Command_Sent_Cursor_Pos, vTerm_Command_Sent_Cursor_At_pos, vTerm.Command_Seq);
+
+        if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
+
+            l_wrap = vTermScreenWrapAdjust(vTerm.Screen_Cursor.Y);
+
+            if (vTerm.Screen_Array_Info[vTerm.Screen_Cursor.Y - l_wrap].Cols >= vTerm.Screen_Cursor.X - 1) {
+
+                l_alpha = false;
+
+                l_proc = true;
+
+                l_ptr = vTermScreenRowByte(&vTerm.Screen_Array_Info[vTerm.Screen_Cursor.Y - l_wrap], vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap], vTerm.Screen_Cursor.X);
+
+                l_scr_len = vTerm.Screen_Array_Info[vTerm.Screen_Cursor.Y - l_wrap].Len;
+
+                if (l_scr_len < l_ptr) {
+                    l_scr_len = l_ptr + 1;
+                }
+
+                while (l_ptr > 0 && l_proc == true) {
+
+                    if (isalnum((unsigned char)vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr])) {
+                        l_alpha = true;
+                    }
+                    else if (!isascii(vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr])) {
+                        l_proc = false;
+                    }										
+                    else if (l_ptr > 0 && l_alpha == true) {
+                    
+                        if (!isalnum((unsigned char)vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr]) &&
+                            !isalnum((unsigned char)vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr-1])) {
+
+                            l_ptr = l_ptr + 1;
+
+                            l_proc = false;
+                        
+										}
+                    
+                    }
+
+                    if (l_proc == true || vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr - 1] != ' ')  l_ptr = l_ptr - 1;
+								}
+
+                if (l_alpha == true) l_proc = true;
+
+                while (l_ptr > 0 && l_proc == true) {
+
+                    if (vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr] == ' ' &&
+                        vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr - 1] == ' ') {
+
+                        l_cmd[0] = '\0';
+
+                        l_scr_pos = l_ptr;
+
+                        l_ptr = l_ptr + 1;
+
+                        while (l_proc == true && l_ptr < l_scr_len) {
+
+                            if (l_ptr > vTerm.Screen_Cursor.X &&
+                                vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr] == ' ' &&
+                                vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr + 1] == ' ') {
+                                l_proc = false;
+                            }
+                            else if (!isascii(vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr])) {
+                                l_proc = false;
                             }
                             else {
 
-                                l_proc = false;
+                                l_alpha = true;
 
-                                if (vTermScreenText_Pos_Y >= 0) {
+                                append_char(l_cmd, vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr], MAX_BUFFER_SIZE);
 
-                                    strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Screen Identifier '%s' Position (Y,X) Mismatch (actual %s vs expected %s) (2)", vTerm.Command_Screen_Identifier, vTerm.Screen_Identifier_Pos, vTerm.Command_Screen_Identifier_Pos));
+                                l_ptr = l_ptr + 1;
 
-                                    vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+                            }
+                        }
 
-                                    vTermCommandMismatch(vTerm.Command_Prompt_OK, vTerm.Screen_Identifier_Pos, vTerm.Command_Screen_Identifier_Pos);
-                                }
+                        if (l_alpha == true) {
+
+                            vTermSessionSetValue(trim(l_cmd), vTerm_Expected_Command_Prompt_pos, vTerm.Command_Seq);
+                            vTermSessionSetValue(dupprintf("%d,%d", vTerm.Screen_Cursor.Y, l_scr_pos + 1), vTerm_Expected_Command_Prompt_At_pos, vTerm.Command_Seq);
+                            vTermSessionSetValue(dupprintf("%d,%d", vTerm.Screen_Cursor.Y, l_scr_pos + 1), vTerm_Command_Prompt_At_pos, vTerm.Command_Seq);
+
+                            strcpy(vTerm.Command_Prompt_Expected, vTermGetCommand(vTerm_Expected_Command_Prompt_pos, false));
+                            strcpy(vTerm.Command_Prompt_Expected_Pos, vTermGetCommand(vTerm_Expected_Command_Prompt_At_pos, false));
+
+                            strcpy(vTerm.Command_Prompt, vTerm.Command_Prompt_Expected);
+                            strcpy(vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
+
+                            l_alpha = false;
 
-                                vTerm.Screen_Identifier_Pos[0] = '\0';
-                            }
                         }
-                    }
-                    else {
+
+                        vTermSessionSetValue(vTerm.Command_Sent_Cursor_Pos, vTerm_Expected_Input_Cursor_At_pos, vTerm.Command_Seq);
 
                         l_proc = false;
 
-                        if (strlen(trim(vTerm.Command_Screen_Identifier_Pos)) > 0)
-                            strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Screen Identifier '%s' Not Found (expected at %s)", vTerm.Command_Screen_Identifier, vTerm.Command_Screen_Identifier_Pos));
-                        else
-                            strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Screen Identifier '%s' Not Found", vTerm.Command_Screen_Identifier));
+                    }
+                    else if (isascii(vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr])) {
+                        l_alpha = true;
+                    }
 
-                        vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+                    l_ptr = l_ptr - 1;
 
-                        vTermCommandMismatch(vTerm.Command_Prompt_OK, "", vTerm.Command_Screen_Identifier);
-                    }
                 }
 
-                if ((l_proc == true) && (vTerm.Command_Prompt_Expected_Len > 0)) {
+                if (l_alpha == true) {
 
-                    if ((vTerm.Screen_Cursor.X < 0) || (strlen(trim(vTerm.Screen))) <= 0) {
+                    vTermSessionSetValue(rtrim(mid(vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap], l_ptr, vTerm.Screen_Cursor.X - 1)), vTerm_Expected_Command_Prompt_pos, vTerm.Command_Seq);
+                    vTermSessionSetValue(dupprintf("%d,%d", vTerm.Screen_Cursor.Y, l_ptr), vTerm_Expected_Command_Prompt_At_pos, vTerm.Command_Seq);
+                    vTermSessionSetValue(dupprintf("%d,%d", vTerm.Screen_Cursor.Y, l_ptr), vTerm_Command_Prompt_At_pos, vTerm.Command_Seq);
 
-                        if (vTermLog_Execution == true) {
+                    strcpy(vTerm.Command_Prompt_Expected, vTermGetCommand(vTerm_Expected_Command_Prompt_pos, false));
+                    strcpy(vTerm.Command_Prompt_Expected_Pos, vTermGetCommand(vTerm_Expected_Command_Prompt_At_pos, false));
 
-                            if (vTerm.Screen_Cursor.X < 0)
-                                vTermWriteToLog("vTermSendCommand|Screen_Cursor.X < 0", NULL, NULL);
+                    strcpy(vTerm.Command_Prompt, vTerm.Command_Prompt_Expected);
+                    strcpy(vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
+                }
 
-                            if (strlen(trim(vTerm.Screen)) <= 0)
-                                vTermWriteToLog("vTermSendCommand|Screen < 0", NULL, NULL);
-                        }
+                vTermSessionSetValue(vTerm.Command_Sent_Cursor_Pos, vTerm_Expected_Input_Cursor_At_pos, vTerm.Command_Seq);
+            }
+        }
+    }
 
-                        return;
-                    }
+    sgrowarray(vTerm.Command_Processed, vTerm.Command_Processed_Size, vTerm.Input_Len + Seq_Len);
+
+    for (int i = 0; i < Seq_Len; i++) {
+        vTerm.Command_Processed[vTerm.Input_Len++] = Seq[i];
+    }
+
+    vTerm.Command_Processed[vTerm.Input_Len] = '\0';
+
+    vTerm.Command_Processed_Len = vTerm.Input_Len;
+
+    if (!(vTerm.Command_Processing_Started == true)) {
+        vTerm.Input_ASCII_Len = 0;
+    }
+
+    /* Up to three digits and a comma per byte. */
+    sgrowarray(vTerm.Command_Processed_ASCII, vTerm.Command_Processed_ASCII_Size, vTerm.Input_ASCII_Len + Seq_Len * 4);
+
+    for (int i = 0; i < Seq_Len; i++) {
+        vTerm.Input_ASCII_Len += sprintf(&vTerm.Command_Processed_ASCII[vTerm.Input_ASCII_Len], (vTerm.Input_ASCII_Len > 0 ? ",%d" : "%d"), (unsigned char)Seq[i]);
+    }
 
-                    l_screen_pos = instrrev(vTerm.Screen, vTerm.Command_Prompt_Expected);
+    vTerm.Command_Processing_Started = true;
 
-                    if (l_screen_pos < 0 ) {
+    vTerm.Command_Processed_Logging = true;
 
-                        l_proc = false;
+    l_proc = false;
 
-                        if (strlen(trim(vTerm.Command_Prompt_Expected_Pos)) > 0)
-                            strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Command Prompt '%s' Not Found (expected at %s)", vTerm.Command_Prompt_Expected, vTerm.Command_Prompt_Expected_Pos));
-                        else
-                            strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Command Prompt '%s' Not Found", vTerm.Command_Prompt_Expected));
+    l_submit = false;
 
-                        vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+    if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
+        l_proc = true;
+    }
+    else if (vTerm.Command_Sent_Len + vTerm.Submit_Key_Len <= 0) {
+        l_proc = true;
+    }
+    else if (vTerm.Submit_Key_Len <= 0 && vTerm.Input_Len == vTerm.Command_Sent_Len && strcmp(vTerm.Command_Processed, vTerm.Command_Sent) == 0) {
+        l_proc = true;
+    }
+    else if (vTerm.Submit_Key_Len > 0 && strcmp(Seq, vTerm.Submit_Key_ANSI) == 0 && !vTermPasting()) {
 
-                        vTermCommandMismatch(vTerm.Command_Prompt_OK, "", vTerm.Command_Prompt_Expected);
+        l_proc = true;
 
-                    }
-                    else if (l_screen_pos > vTerm.Screen_Ptr) {
+        l_submit = true;
+    }
 
-                        strcpy(vTerm.Command_Prompt_Pos, vTermScreenTextPosition(vTerm.Command_Prompt_Expected, false));
+    if (l_proc == true) {
 
-                        if (strlen(trim(vTerm.Command_Prompt_Pos)) > 0) {
-                            vTermSessionSetValue( vTerm.Command_Prompt_Pos, vTerm_Command_Prompt_At_pos, vTerm.Command_Seq);
-                        }
+        l_proc = false;
 
-                        if (strlen(trim(vTerm.Command_Prompt_Expected_Pos)) > 0) {
+        if (l_submit == true || vTerm.Command_Seq > vTerm.Command_Seq_Max) {
+            l_proc = true;
+        }
+        else if (vTerm.Command_Sent_Len > 0 && vTerm.Input_Len == vTerm.Command_Sent_Len && strcmp(vTerm.Command_Processed, vTerm.Command_Sent) == 0) {
 
-                            if (vTerm.Command_Prompt_Expected_Pos_Y < 0 || vTerm.Command_Prompt_Expected_Pos_Y == vTermScreenText_Pos_Y) {
+            if (!(vTerm.Screen_Cursor_Prev_X == vTerm.Screen_Cursor.X - vTerm.Command_Send_Buffer_Len && vTerm.Screen_Cursor_Prev_Y == vTerm.Screen_Cursor.Y)) {
+                l_proc = true;
+            }
+        }
+        else if ((vTerm.Command_Sent_Len <= 0 && Last == true) && (vTerm.Command_Processing == true)) {
+            l_proc = true;
+        }
 
-                                if (vTerm.Command_Prompt_Expected_Pos_X < 0 || vTerm.Command_Prompt_Expected_Pos_X == vTermScreenText_Pos_X) {
+        if (l_proc == true) {
 
-                                    vTermSessionSetValue(vTerm.Command_Prompt_Pos, vTerm_Command_Prompt_At_pos, vTerm.Command_Seq);
+            /* The token is the whole key sequence, however the ldisc_send calls split it. */
+            vTermSubmitKey(Seq, true);
 
-                                    if (vTermLog_Execution == true) {
-                                        vTermWriteToLog(dupprintf("Command Prompt '%s' Position Matches OK (expected at %s)", vTerm.Command_Prompt_Expected, vTerm.Command_Prompt_Expected_Pos), vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
-                                    }
-                                }
-                                else {
+            vTermSessionSetValue(vTerm.Command_Processed_ASCII, vTerm_Command_Processed_ASCII_pos, vTerm.Command_Seq);
 
-                                    l_proc = false;
+            if (vTerm.Command_Submit_Key == true) {
 
-                                    if (vTermScreenText_Pos_Y >= 0) {
+                l_cmd_len = strlen(vTerm.Command_Processed) - vTerm.Command_Processed_Submit_Key_Len;
 
-                                        strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Command Prompt '%s' Position (Y,X) Mismatch (actual %s vs expected %s) (1)", vTerm.Command_Prompt_Expected, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos));
+                vTerm.Input_Len = (l_cmd_len > 0 ? l_cmd_len : 0);
 
-                                        vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+                vTerm.Command_Processed[vTerm.Input_Len] = '\0';
 
-                                        vTermCommandMismatch(vTerm.Command_Prompt_OK, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
+                vTermSessionSetValue(vTerm.Command_Processed_Submit_Key, vTerm_Command_Processed_Submit_Key_pos, vTerm.Command_Seq);
 
-                                    }
+                if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
+                    vTermSessionSetValue(vTerm.Command_Processed_Submit_Key, vTerm_Command_Submit_Key_pos, vTerm.Command_Seq);
+                }
 
-                                    vTerm.Command_Prompt_Pos[0] = '\0';
-                                }
-                            }
-                            else {
+                l_submit_key = true;
+            }
+            else if (vTerm.Submit_Key_Len <= 0 && vTerm.Command_Processed_Len == vTerm.Command_Send_Len) {
+                l_submit_key = true;
+            }
 
-                                l_proc = false;
+            if (l_submit_key == true || vTerm.Command_Seq > vTerm.Command_Seq_Max) {
 
-                                if (vTermScreenText_Pos_Y >= 0) {
+                vTermSessionSetValue(vTerm.Command_Processed, vTerm_Command_Processed_pos, vTerm.Command_Seq);
 
-                                    strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Command Prompt '%s' Position (Y,X) Mismatch (actual %s vs expected %s) (2)", vTerm.Command_Prompt_Expected, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos));
+                if (l_submit_key == true) {
+                    vTermSetCommandProcessed();
+                }
+                else if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
+                    vTermSessionSetValue(vTerm.Command_Processed, vTerm_Command_Send_pos, vTerm.Command_Seq);
+                }
+            }
 
-                                    vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+            if (vTerm.Command_Seq <= vTerm.Command_Seq_Max) {
 
-                                    vTermCommandMismatch(vTerm.Command_Prompt_OK, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
-                                }
+                vTerm.Command_Processed_Manual_Input[0] = '\0';
 
-                                vTerm.Command_Prompt_Pos[0] = '\0';
-                            }
-                        }
+                vTerm.Command_Processed_Len = 0;
+                vTerm.Command_Processing_Started = false;
+                vTerm.Command_Processing_Finished = true;
+            }
 
-                        if (l_proc == true) {
-                            vTerm.Screen_Ptr = l_screen_pos;
-                        }
-                    }
-                    else {
+            vTerm.Command_Send_Buffer_Len = 0;
+            vTerm.Command_Send_Pos = 0;
 
-                        l_proc = false;
+            vTerm.Submit_Key_Len = 0;
 
-                        if (vTermScreenText_Pos_Y >= 0) {
+            vTerm.Command_Sent[0] = '\0';
 
-                            strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Command Prompt '%s' Position (Y,X) Mismatch (actual %s vs expected %s) (3)", vTerm.Command_Prompt_Expected, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos));
+            vTerm.Command_Sent_Len = 0;
+            vTerm.Command_Processing = false;
+        }
+    }
+}
 
-                            vTermSessionSetValue( vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+void vTermInputEmit(bool Last) {
 
-                            if (vTerm.Screen_Requested_Seq < vTerm.Command_Seq) {
-                                vTermSessionGetScreen( false);
-                            }
-                            else {
+    vTermInputKey(vTerm.Input_Pending, vTerm.Input_Pending_Len, Last);
 
-                                vTerm.Command_Mismatch = true;
+    vTerm.Input_Pending_Len = 0;
+    vTerm.Input_Pending[0] = '\0';
 
-                                vTermCommandMismatch(vTerm.Command_Prompt_OK, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
+    vTerm.Input_State = 0;
+}
 
-                            }
-                        }
-                    }
-                }
+/* Split user input into tokens one byte at a time: a text byte, or a whole key sequence walked through the key code trie, which may span ldisc_send calls. */
+void vTermInputFeed(char* Input, int Input_Len) {
 
-                if (l_proc == true) {
+    unsigned char l_chr;
+    int l_next;
 
-                    vTerm.Command_Mismatch = false;
+    /* The bracketed paste markers come in calls of their own and are not user input. */
+    if (Input_Len == 6 && (memcmp(Input, "\033[200~", 6) == 0 || memcmp(Input, "\033[201~", 6) == 0)) {
+        return;
+    }
 
-                    strcpy(vTerm.Command_Prompt_OK, "Yes");
+    vTerm.Input_At = GETTICKCOUNT();
 
-                    vTermSessionSetValue( vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+    for (int i = 0; i < Input_Len; i++) {
 
-                    vTerm.Command_Prompt_Expected_Len = -99;
+        l_chr = (unsigned char)Input[i];
 
-                    if (vTerm.Hwnd > 0 && !(vTerm_Stop == true)) {
+        if (l_chr == 0) {
+            continue;
+        }
 
-                        if (!(vTerm.Command_Wait == true)) {
-                            vTermCommandSend( !SessionsKeyPressSync);
-                        }
-                    }
-                }
-            }
-            else if (vTerm.Screen_Cursor.Y >= 0 && (vTerm.Command_Prompt_Expected_Pos_Y > 0 || vTerm.Command_Prompt_Expected_Pos_X> 0)) {
+        if (vTerm.Input_Pending_Len > 0) {
 
-                if (strlen(vTerm.Command_Prompt_Expected_Pos) <= 0) {
-                    vTerm.Command_Seq = vTerm.Command_Seq;
-                }
+            l_next = vTermKeyStateGoto(vTerm.Input_State, l_chr);
 
-                strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Screen Cursor Position (Y,X) Mismatch (actual %s vs expected %s) (4)", ifnull(vTerm.Command_Prompt_Pos, "not found"), vTerm.Command_Prompt_Expected_Pos));
+            if (l_next >= 0 && vTerm.Input_Pending_Len < MAX_STRING_LENGTH - 1) {
 
-                vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+                vTerm.Input_Pending[vTerm.Input_Pending_Len++] = l_chr;
+                vTerm.Input_Pending[vTerm.Input_Pending_Len] = '\0';
 
-                vTermCommandMismatch(vTerm.Command_Prompt_OK, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
+                vTerm.Input_State = l_next;
 
-                if (vTermLog_Execution == true) {
-                    vTermWriteToLog( "vTermSendCommand|Cursor X Position (Y,X) Mismatch", dupprintf("%d", (vTerm.Screen_Cursor.X - vTerm.Command_Send_Pos)), dupprintf("%d", vTerm.Command_Send_Expected_Cursor_X));
+                if (vTermKeyStates[l_next].Child < 0) {
+                    vTermInputEmit(i == Input_Len - 1);
                 }
+
+                continue;
             }
+
+            vTermInputEmit(false);
         }
-        else if (vTerm.Screen_Cursor.Y >= 0 && (vTerm.Command_Prompt_Expected_Pos_Y > 0 || vTerm.Command_Prompt_Expected_Pos_X > 0)) {
 
-            strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Screen Cursor Position (Y,X) Mismatch (actual %s vs expected %s) (5)", ifnull(vTerm.Command_Prompt_Pos, "not found"), vTerm.Command_Prompt_Expected_Pos));
+        l_next = (vTermKeyStates_Count > 0 ? vTermKeyStateGoto(0, l_chr) : -1);
 
-            vTermSessionSetValue(vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+        vTerm.Input_Pending[0] = l_chr;
+        vTerm.Input_Pending[1] = '\0';
 
-            vTermCommandMismatch(vTerm.Command_Prompt_OK, vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
+        vTerm.Input_Pending_Len = 1;
 
-            if (vTermLog_Execution == true) {
-                vTermWriteToLog( "vTermSendCommand|Cursor Y Position (Y,X) Mismatch", dupprintf("%d", vTerm.Screen_Cursor.Y), dupprintf("%d", vTerm.Command_Send_Expected_Cursor_Y));
-            }
+        if (l_next < 0 || vTermKeyStates[l_next].Child < 0) {
+            vTermInputEmit(i == Input_Len - 1);
+        }
+        else {
+            vTerm.Input_State = l_next;
         }
     }
+}
+
+/* A sequence that could still grow (a lone Escape) is taken as it stands once no more input follows it. */
+void vTermInputFlush() {
+
+    if (vTerm.Input_Pending_Len <= 0) {
+        return;
+    }
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog( "vTermSendCommand|Finish", vTerm.Command_Sent, vTerm.Command_Send);
+    if (vTermTickReached(vTerm.Input_At + vTerm_Input_Key_Wait)) {
+        vTermInputEmit(true);
+    }
+    else {
+        vTermTimerSchedule(vTerm.Input_At + vTerm_Input_Key_Wait);
     }
 }
 
-void vTermSessionInitialise(int SessionID) {
+/* The command times out once the screen has been quiet for its timeout (vTerm_Command_TimeOut seconds unless the script gives one) after its send pause. */
+void vTermCommandTimeout() {
 
-    vTerm.Command_Seq = 1;
-    vTerm.Command_Current_Seq = -1;
-    vTerm.Command_Seq_Max = -1;
-    vTerm.Command_Prompt[0] = '\0';
-    vTerm.Command_Prompt_Pos[0] = '\0';
-    vTerm.Command_Prompt_Len = 0;
-    vTerm.Command_Prompt_OK[0] = '\0';
-    vTerm.Command_Processed_Manual_Input[0] = '\0';
-    vTerm.Command_Mismatch = false;
-    vTerm.Command_Mismatch_Type[0] = '\0';
-    vTerm.Command_Mismatch_Pos_Expected[0] = '\0';
-    vTerm.Command_Mismatch_Pos_Actual[0] = '\0';
-    vTerm.Command_Processing = false;
-    vTerm.Command_Processing_Started = false;
-    vTerm.Command_Processing_Finished = false;
-    vTerm.Command_Processed_ASCII[0] = '\0';
-    vTerm.Command_Processed[0] = '\0';
-    vTerm.Command_Processed_Len = 0;
-    vTerm.Command_Current_Seq = -1;
-    vTerm.Command_Screen_Identifier[0] = '\0';
-    vTerm.Command_Screen_Identifier_Len = 0;
-    vTerm.Command_Submit_Key = false;
-    vTerm.Command_Wait = false;
-    vTerm.Commands_Input[0] = '\0';
-    vTerm.Commands_Processed[0] = '\0';
-    vTerm.Controller_Updated_Seq = -1;
-    vTerm.Screen[0] = '\0';
-    vTerm.Screen_Capture_Offset = 0;
-    vTerm.Screen_Capture_RGB = 0;
-    vTerm.Screen_Get = false;
-    vTerm.Screen_Ptr = -1;
-    vTerm.Screen_Raw[0] = '\0';
-    vTerm.Screen_Raw_ASCII[0] = '\0';
-    vTerm.Pid = 0L;
-    vTerm.Hwnd = 0L;
-    vTerm.Screen_Command_Seq_From = 1;
-    vTerm.Screen_Capture_Command_Seq_From = 1;
-    vTerm.Screen_Cursor_Prev_X = -1;
-    vTerm.Screen_Cursor_Prev_Y = -1;
-    
-    memset(vTerm.Screen_Array, 0, sizeof(vTerm.Screen_Array));
+    unsigned long l_from;
+    int l_seq;
 
-    vTerm.Screen_Array_Rows = 0;
-    vTerm.Screen_New_Rows = 0;
+    if (!(vTerm.Command_Deadline == true) || vTerm.Command_Mismatch == true || vTerm.Command_Seq > vTerm.Command_Seq_Max) {
+        return;
+    }
 
-    vTerm_Stop = false;
+    l_from = vTerm.Command_Wait_Until;
 
-    if (strlen(vterm_capture_file) >= 0) {
-        vTermOpenSessionFiles();
+    if ((long)(vTerm.Command_Send_At - l_from) > 0) l_from = vTerm.Command_Send_At;
+    if ((long)(vTerm.Row_Updated_At - l_from) > 0) l_from = vTerm.Row_Updated_At;
+
+    if (!vTermTickReached(l_from + vTerm.Command_Timeout)) {
+
+        vTermTimerSchedule(l_from + vTerm.Command_Timeout);
+
+        return;
+    }
+
+    l_seq = vTerm.Command_Seq;
+
+    if (vTerm.Screen_Requested_Seq < vTerm.Command_Seq) {
+        vTermSessionGetScreen(true);
     }
+
+    if (l_seq != vTerm.Command_Seq || vTerm.Command_Mismatch == true) {
+        return;
+    }
+
+    vTerm.Command_Deadline = false;
+
+    if (vTerm.Command_Timeout % TICKSPERSEC == 0)
+        strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Command Timeout (no screen update for %d seconds)", vTerm.Command_Timeout / TICKSPERSEC));
+    else
+        strcpy(vTerm.Command_Prompt_OK, dupprintf("No : Command Timeout (no screen update for %d ms)", vTerm.Command_Timeout));
+
+    vTermSessionSetValue( vTerm.Command_Prompt_OK, vTerm_Command_Prompt_OK_pos, vTerm.Command_Seq);
+
+    vTerm.Command_Mismatch = true;
+
+    vTermCommandMismatch(vTerm.Command_Prompt_OK, vTerm.Command_Current_Cursor_Pos, vTerm.Command_Prompt_Expected_Pos);
 }
 
 void vTermWaitingForInput( int Cursor_X, int Cursor_Y, int Columns_X, int Rows_Y, bool Command_Processing) {
@@ -2300,6 +6490,10 @@ void vTermWaitingForInput( int Cursor_X, int Cursor_Y, int Columns_X, int Rows_Y
         return;
     }
 
+    vTermCommandTimeout();
+
+    vTermInputFlush();
+
     if (vTerm.Screen_Cursor.X == Cursor_X && vTerm.Screen_Cursor.Y == Cursor_Y && vTerm.Command_Mismatch == true) {
 
         if (vTermLog_Execution == true) {
@@ -2333,207 +6527,291 @@ void vTermWaitingForInput( int Cursor_X, int Cursor_Y, int Columns_X, int Rows_Y
 
                 vTermSessionGetScreen(false);
 
+                sgrowarray(vTerm.Command_Processed_Manual_Input, vTerm.Command_Processed_Manual_Input_Size, strlen(vTerm.Command_Processed));
+
                 strcpy(vTerm.Command_Processed_Manual_Input, vTerm.Command_Processed);
 
-                vTerm.Screen_Cursor_Prev_X = vTerm.Screen_Cursor.X;
-                vTerm.Screen_Cursor_Prev_Y = vTerm.Screen_Cursor.Y;
+                vTerm.Screen_Cursor_Prev_X = vTerm.Screen_Cursor.X;
+                vTerm.Screen_Cursor_Prev_Y = vTerm.Screen_Cursor.Y;
+
+                strcpy(vTerm.Command_Current_Cursor_Pos, dupprintf("%d,%d",vTerm.Screen_Cursor.Y, vTerm.Screen_Cursor.X));
+
+                vTermSessionSetValue( vTerm.Command_Current_Cursor_Pos, vTerm_Current_Cursor_pos, vTerm.Command_Seq);
+            }
+        }
+    }
+    /* Command is being processed. */
+    else if (vTerm.Command_Processing == true) {
+
+        vTermSessionGetScreen(false);
+
+        if (!toplevel_callback_pending()) {
+
+            if (!(vTerm.Screen_Cursor_Prev_X == vTerm.Screen_Cursor.X && vTerm.Screen_Cursor_Prev_Y == vTerm.Screen_Cursor.Y)) {
+
+            strcpy(vTerm.Command_Current_Cursor_Pos, dupprintf("%d,%d", vTerm.Screen_Cursor.Y, vTerm.Screen_Cursor.X));
+
+            vTermSendCommand();
+            }
+            else if (vTerm.Command_Send_Buffer_Len + vTerm.Submit_Key_Len > 0) {
+                vTermSendCommand();
+            }
+
+        }
+    }
+    /* Waiting for input. */
+    else if (vTerm.Command_Send_Buffer_Len + vTerm.Submit_Key_Len > 0) {
+        vTermSendCommand();
+    }
+    else if (vTermLog_Execution == true) {
+        vTermWriteToLog( "vTermWaitingForInput|No input command set", dupprintf("%d", Cursor_X), dupprintf("%d", Cursor_Y));
+    }
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog( "vTermWaitingForInput|Finish", dupprintf("%d", Cursor_X), dupprintf("%d", Cursor_Y));
+    }
+}
+
+const int vTermStateEvents[] = {
+    vTerm_Event_Data | vTerm_Event_Cursor | vTerm_Event_Timer,
+    vTerm_Event_Data | vTerm_Event_Cursor | vTerm_Event_Timer,
+    vTerm_Event_Data | vTerm_Event_Cursor | vTerm_Event_Timer,
+    vTerm_Event_Timer,
+    vTerm_Event_Timer,
+    vTerm_Event_Cursor | vTerm_Event_Input | vTerm_Event_Timer
+};
+
+const char* vTermStateNames[] = { "AwaitScreen", "AwaitEcho", "AwaitSubmit", "Paused", "Mismatch", "Manual" };
+
+int vTermState() {
+
+    if (vTerm.Command_Mismatch == true) {
+        return vTerm_State_Mismatch;
+    }
+
+    if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
+        return vTerm_State_Manual;
+    }
+
+    if (!vTermTickReached(vTerm.Command_Wait_Until)) {
+
+        vTermTimerSchedule(vTerm.Command_Wait_Until);
+
+        return vTerm_State_Paused;
+    }
+
+    if (vterm_screen_speed > 0 && !vTermTickReached(vTerm.Command_Send_At + vterm_screen_speed)) {
 
-                strcpy(vTerm.Command_Current_Cursor_Pos, dupprintf("%d,%d",vTerm.Screen_Cursor.Y, vTerm.Screen_Cursor.X));
+        vTermTimerSchedule(vTerm.Command_Send_At + vterm_screen_speed);
 
-                vTermSessionSetValue( vTerm.Command_Current_Cursor_Pos, vTerm_Current_Cursor_pos, vTerm.Command_Seq);
-            }
-        }
+        return vTerm_State_Paused;
     }
-    /* Command is being processed. */
-    else if (vTerm.Command_Processing == true) {
 
-        vTermSessionGetScreen(false);
+    if (vTerm.Command_Send_Buffer_Len > 0 && vTerm.Command_Sent_Len > 0) {
+        return vTerm_State_AwaitEcho;
+    }
 
-        if (!toplevel_callback_pending()) {
+    if (vTerm.Command_Send_Buffer_Len <= 0 && vTerm.Submit_Key_Len > 0) {
+        return vTerm_State_AwaitSubmit;
+    }
 
-            if (!(vTerm.Screen_Cursor_Prev_X == vTerm.Screen_Cursor.X && vTerm.Screen_Cursor_Prev_Y == vTerm.Screen_Cursor.Y)) {
+    return vTerm_State_AwaitScreen;
+}
 
-            strcpy(vTerm.Command_Current_Cursor_Pos, dupprintf("%d,%d", vTerm.Screen_Cursor.Y, vTerm.Screen_Cursor.X));
+/* Runs the transitions for the events raised since the last call, if the current state has any for them. */
+void vTermEvent(int Events, Terminal* term) {
 
-            vTermSendCommand();
-            }
+    int l_state = vTermState();
 
-        }
-    }
-    /* Waiting for input. */
-    else if (vTerm.Command_Send_Buffer_Len + vTerm.Submit_Key_Len > 0) {
-        vTermSendCommand();
-    }
-    else if (vTermLog_Execution == true) {
-        vTermWriteToLog( "vTermWaitingForInput|No input command set", dupprintf("%d", Cursor_X), dupprintf("%d", Cursor_Y));
+    if (l_state != vTerm.State && vTermLog_Execution == true) {
+        vTermWriteToLog("vTermEvent|State", vTermStateNames[l_state], vTermStateNames[vTerm.State]);
     }
 
-    if (vTermLog_Execution == true) {
-        vTermWriteToLog( "vTermWaitingForInput|Finish", dupprintf("%d", Cursor_X), dupprintf("%d", Cursor_Y));
+    vTerm.State = l_state;
+
+    if ((Events & vTermStateEvents[l_state]) == 0) {
+        return;
     }
+
+    /* A cursor move while the script runs is the pass PuttyDriver #6 used to make from term_out, now the only one for it. */
+    vTermWaitingForInput(term->curs.x, term->curs.y, term->cols, term->rows, (Events & vTerm_Event_Cursor) != 0 && l_state != vTerm_State_Manual);
+
+    vTerm.Command_Processing = false;
+
+    vTerm.State = vTermState();
 }
 
 void vTermSetCommandProcessed()
 {
-    char command_input[MAX_BUFFER_SIZE];
+    char* command_input;
 
     if (strcmp(vTerm.Command_Input_Hidden, "Yes") == 0) {
-        strcpy(command_input, "##private##");
+        command_input = "##private##";
     }
     else if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
-        strcpy(command_input, trim(string_replacechar(vTerm.Command_Processed, '\r', ' ')));
+        command_input = trim(string_replacechar(vTerm.Command_Processed, '\r', ' '));
     }
     else {
-        strcpy(command_input, vTerm.Command_Send);
+        command_input = vTerm.Command_Send;
     }
 
     if (strlen(trim(vTerm.Commands_Input)) > 0) {
-        append_char(vTerm.Commands_Input, '\n', MAX_BUFFER_SIZE);
-    }
-
-    append_string(vTerm.Commands_Input, dupprintf("%d", vTerm.Command_Seq), MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Input, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Input, vTerm.Command_Screen_Identifier, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Input, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Input, vTerm.Command_Screen_Identifier_Pos, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Input, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Input, vTerm.Screen_Capture, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Input, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Input, vTerm.Command_Prompt_Expected, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Input, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Input, vTerm.Command_Prompt_Expected_Pos, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Input, DBDelimiter, MAX_BUFFER_SIZE);
+        vTermRecordChar(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, '\n');
+    }
+
+    vTermRecordString(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, dupprintf("%d", vTerm.Command_Seq));
+    vTermRecordChar(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, vTerm.Command_Screen_Identifier);
+    vTermRecordChar(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, vTerm.Command_Screen_Identifier_Pos);
+    vTermRecordChar(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, vTerm.Screen_Capture);
+    vTermRecordChar(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, vTerm.Command_Prompt_Expected);
+    vTermRecordChar(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, vTerm.Command_Prompt_Expected_Pos);
+    vTermRecordChar(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, DBDelimiter);
 
     if (vTerm.Command_Seq <= vTerm.Command_Seq_Max)
-        append_string(vTerm.Commands_Input, vTerm.Command_Send_Expected_Cursor, MAX_BUFFER_SIZE);
+        vTermRecordString(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, vTerm.Command_Send_Expected_Cursor);
     else
-        append_string(vTerm.Commands_Input, vTerm.Command_Sent_Cursor_Pos, MAX_BUFFER_SIZE);
+        vTermRecordString(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, vTerm.Command_Sent_Cursor_Pos);
 
-    append_char(vTerm.Commands_Input, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Input, command_input, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Input, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Input, vTerm.Command_Input_Hidden, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Input, DBDelimiter, MAX_BUFFER_SIZE);
+    vTermRecordChar(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, command_input);
+    vTermRecordChar(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, vTerm.Command_Input_Hidden);
+    vTermRecordChar(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, DBDelimiter);
 
     if (vTerm.Command_Seq <= vTerm.Command_Seq_Max)
-        append_string(vTerm.Commands_Input, vTerm.Submit_Key, MAX_BUFFER_SIZE);
+        vTermRecordString(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, vTerm.Submit_Key);
     else
-        append_string(vTerm.Commands_Input, vTerm.Command_Processed_Submit_Key, MAX_BUFFER_SIZE);
+        vTermRecordString(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, vTerm.Command_Processed_Submit_Key);
+
+    vTermRecordChar(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, DBDelimiter);
 
-    append_char(vTerm.Commands_Input, DBDelimiter, MAX_BUFFER_SIZE);
+    vTermRecordString(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, vTermPauseField());
 
-    if (vTerm.Command_Send_Pause > 0) append_string(vTerm.Commands_Input, dupprintf("%d", vTerm.Command_Send_Pause), MAX_BUFFER_SIZE);
+    vTermRecordChar(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, DBDelimiter);
 
-    append_char(vTerm.Commands_Input, DBDelimiter, MAX_BUFFER_SIZE);
+    if (vTerm.Command_Script_DB_ID > 0) vTermRecordString(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, dupprintf("%d", vTerm.Command_Script_DB_ID));
 
-    if (vTerm.Command_Script_DB_ID > 0) append_string(vTerm.Commands_Input, dupprintf("%d", vTerm.Command_Script_DB_ID), MAX_BUFFER_SIZE);
+    vTermRecordChar(&vTerm.Commands_Input, &vTerm.Commands_Input_Size, DBDelimiter);
 
-    append_char(vTerm.Commands_Input, DBDelimiter, MAX_BUFFER_SIZE);
+    vTermRecordDatasetRow(&vTerm.Commands_Input, &vTerm.Commands_Input_Size);
+    vTermRecordTimeout(&vTerm.Commands_Input, &vTerm.Commands_Input_Size);
 
     if (strlen(trim(vTerm.Commands_Processed)) > 0) {
-        append_char(vTerm.Commands_Processed, '\n', MAX_BUFFER_SIZE);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, '\n');
     }
 
     if (vTerm.Command_Seq <= vTerm.Command_Seq_Max) {
 
-        append_string(vTerm.Commands_Processed, dupprintf("<command_input_script>%d", vTerm.Command_Seq), MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Command_Screen_Identifier, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Command_Screen_Identifier_Pos, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Screen_Capture, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Command_Prompt_Expected, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Command_Prompt_Expected_Pos, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Command_Send_Expected_Cursor, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, command_input, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Command_Input_Hidden, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Submit_Key, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        if (vTerm.Command_Send_Pause > 0) append_string(vTerm.Commands_Processed, dupprintf("%d", vTerm.Command_Send_Pause), MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        if (vTerm.Command_Script_DB_ID > 0) append_string(vTerm.Commands_Processed, dupprintf("%d", vTerm.Command_Script_DB_ID), MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, "</command_input_script>", MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, '\n', MAX_BUFFER_SIZE);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, dupprintf("<command_input_script>%d", vTerm.Command_Seq));
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Screen_Identifier);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Screen_Identifier_Pos);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Screen_Capture);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Prompt_Expected);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Prompt_Expected_Pos);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Send_Expected_Cursor);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, command_input);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Input_Hidden);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Submit_Key);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTermPauseField());
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        if (vTerm.Command_Script_DB_ID > 0) vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, dupprintf("%d", vTerm.Command_Script_DB_ID));
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordDatasetRow(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size);
+        vTermRecordTimeout(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, "</command_input_script>");
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, '\n');
 
     }
     else {
 
-        append_string(vTerm.Commands_Processed, dupprintf("<command_input_user>%d", vTerm.Command_Seq), MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Command_Screen_Identifier, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Command_Screen_Identifier_Pos, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Screen_Capture, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Command_Prompt_Expected, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Command_Prompt_Expected_Pos, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Command_Sent_Cursor_Pos, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, command_input, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Command_Input_Hidden, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, vTerm.Command_Processed_Submit_Key, MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        if (vTerm.Command_Send_Pause > 0) append_string(vTerm.Commands_Processed, dupprintf("%d", vTerm.Command_Send_Pause), MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        if (vTerm.Command_Script_DB_ID > 0) append_string(vTerm.Commands_Processed, dupprintf("%d", vTerm.Command_Script_DB_ID), MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-        append_string(vTerm.Commands_Processed, "</command_input_user>", MAX_BUFFER_SIZE);
-        append_char(vTerm.Commands_Processed, '\n', MAX_BUFFER_SIZE);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, dupprintf("<command_input_user>%d", vTerm.Command_Seq));
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Screen_Identifier);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Screen_Identifier_Pos);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Screen_Capture);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Prompt_Expected);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Prompt_Expected_Pos);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Sent_Cursor_Pos);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, command_input);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Input_Hidden);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Processed_Submit_Key);
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTermPauseField());
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        if (vTerm.Command_Script_DB_ID > 0) vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, dupprintf("%d", vTerm.Command_Script_DB_ID));
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+        vTermRecordDatasetRow(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size);
+        vTermRecordTimeout(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, "</command_input_user>");
+        vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, '\n');
 
     }
     
     if (strcmp(vTerm.Command_Input_Hidden, "Yes") != 0) 
-        strcpy(command_input, vTerm.Command_Processed);
+        command_input = vTerm.Command_Processed;
     else
-        command_input[0] = '\0';
-
-    append_string(vTerm.Commands_Processed, dupprintf("<command_processed>%d", vTerm.Command_Seq), MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Processed, vTerm.Command_Screen_Identifier, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Processed, vTerm.Screen_Identifier_Pos, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Processed, vTerm.Screen_Capture, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Processed, vTerm.Command_Prompt, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
+        command_input = "";
+
+    vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, dupprintf("<command_processed>%d", vTerm.Command_Seq));
+    vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Screen_Identifier);
+    vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Screen_Identifier_Pos);
+    vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Screen_Capture);
+    vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Prompt);
+    vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
 
     if (vTerm.Command_Seq <= vTerm.Command_Seq_Max)
-        append_string(vTerm.Commands_Processed, vTerm.Command_Prompt_Pos, MAX_BUFFER_SIZE);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Prompt_Pos);
     else
-        append_string(vTerm.Commands_Processed, vTerm.Command_Sent_Cursor_Pos, MAX_BUFFER_SIZE);
+        vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Sent_Cursor_Pos);
         
-    append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Processed, vTerm.Command_Sent_Cursor_Pos, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Processed, command_input, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Processed, vTerm.Command_Input_Hidden, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Processed, vTerm.Command_Processed_Submit_Key, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Processed, vTerm.Command_Prompt_OK, MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-    if (vTerm.Command_Send_Pause > 0) append_string(vTerm.Commands_Processed, dupprintf("%d", vTerm.Command_Send_Pause), MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-    if (vTerm.Command_Script_DB_ID > 0) append_string(vTerm.Commands_Processed, dupprintf("%d", vTerm.Command_Script_DB_ID), MAX_BUFFER_SIZE);
-    append_char(vTerm.Commands_Processed, DBDelimiter, MAX_BUFFER_SIZE);
-    append_string(vTerm.Commands_Processed, "</command_processed>", MAX_BUFFER_SIZE);
+    vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Sent_Cursor_Pos);
+    vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, command_input);
+    vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Input_Hidden);
+    vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Processed_Submit_Key);
+    vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTerm.Command_Prompt_OK);
+    vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+    vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, vTermPauseField());
+    vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+    if (vTerm.Command_Script_DB_ID > 0) vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, dupprintf("%d", vTerm.Command_Script_DB_ID));
+    vTermRecordChar(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, DBDelimiter);
+    vTermRecordDatasetRow(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size);
+    vTermRecordTimeout(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size);
+    vTermRecordString(&vTerm.Commands_Processed, &vTerm.Commands_Processed_Size, "</command_processed>");
 
     vTerm.Screen_Command_Seq_To = vTerm.Command_Seq;
+    vTerm.Screen_Dataset_Row = vTermDataset_Row_Num;
 
     vTerm.Command_Processed_Logging = false;
 
@@ -2555,25 +6833,7 @@ void vTermSetCommandProcessed()
 
 void vTermProcessData(char* PuttyData, int DataLength, int CommandType) {
 
-    char l_cmd[MAX_BUFFER_SIZE];
-    int l_cmd_len;
-
-    char l_fmt[MAX_STRING_LENGTH];
-
-    bool l_alpha;
-    bool l_command;
-    bool l_proc;
-
-    bool l_submit;
-    bool l_submit_key = false;
-
     int l_pos;
-    int l_ptr;
-
-    int l_scr_len;
-    int l_scr_pos;
-
-    int l_wrap;
 
     if (vTerm.Pid <= 0) {
 
@@ -2594,321 +6854,25 @@ void vTermProcessData(char* PuttyData, int DataLength, int CommandType) {
         return;
     }
 
-    vTerm.Row_Updated_At = time(NULL);
+    vTerm.Row_Updated_At = GETTICKCOUNT();
 
-    if (vTerm.Command_Processed_Len <= 0) {
-        l_command = true;
+    if (CommandType == vTerm_Data) {
+        vTermEchoFeed(PuttyData, DataLength);
     }
 
-    if (DataLength > 0) {
-
-        for (l_pos = 0; l_pos < DataLength; l_pos++) {
-
-            if (PuttyData[l_pos] > 0) {
-
-                if (CommandType == vTerm_Command) {
-
-                    if (strlen(trim(vTerm.Command_Sent_Cursor_Pos)) > 0) {
-
-                        if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
-                        
-                            if (strcmp(vTerm.Command_Sent_Cursor_Pos, dupprintf("%d,%d", vTerm.Screen_Cursor.Y, vTerm.Screen_Cursor.X)) == 0) {
-
-                                vTermSessionSetValue("Yes", vTerm_Command_Input_Hidden_pos, vTerm.Command_Seq);
-
-                                strcpy(vTerm.Command_Input_Hidden, "Yes");
-
-                            }
-                        }
-                    }
-                    else {
-
-                        vTerm.Command_Sent_Cursor_X = vTerm.Screen_Cursor.X;
-                        vTerm.Command_Sent_Cursor_Y = vTerm.Screen_Cursor.Y;
-
-                        sprintf(vTerm.Command_Sent_Cursor_Pos, "%d,%d", vTerm.Command_Sent_Cursor_Y, vTerm.Command_Sent_Cursor_X);
-
-                        vTermSessionSetValue(vTerm.Command_Sent_Cursor_Pos, vTerm_Command_Sent_Cursor_At_pos, vTerm.Command_Seq);
-
-                        if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
-
-                            l_wrap = vTermScreenWrapAdjust(vTerm.Screen_Cursor.Y);
-
-                            if (strlen(vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap]) >= vTerm.Screen_Cursor.X - 1) {
-
-                                l_alpha = false;
-
-                                l_proc = true;
-
-                                l_ptr = vTerm.Screen_Cursor.X;
-
-                                l_scr_len = strlen(vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap]);
-
-                                if (l_scr_len < l_ptr) {
-                                    l_scr_len = l_ptr + 1;
-                                }
-
-                                while (l_ptr > 0 && l_proc == true) {
-
-                                    if (isalnum(vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr])) {
-                                        l_alpha = true;
-                                    }
-                                    else if (!isascii(vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr])) {
-                                        l_proc = false;
-                                    }										
-                                    else if (l_ptr > 0 && l_alpha == true) {
-                                    
-                                        if (!isalnum(vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr]) &&
-                                            !isalnum(vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr-1])) {
-
-                                            l_ptr = l_ptr + 1;
-
-                                            l_proc = false;
-                                        
-										}
-                                    
-                                    }
-
-                                    if (l_proc == true || vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr - 1] != ' ')  l_ptr = l_ptr - 1;
-								}
-
-                                if (l_alpha == true) l_proc = true;
-
-                                while (l_ptr > 0 && l_proc == true) {
-
-                                    if (vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr] == ' ' &&
-                                        vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr - 1] == ' ') {
-
-                                        l_cmd[0] = '\0';
-
-                                        l_scr_pos = l_ptr;
-
-                                        l_ptr = l_ptr + 1;
-
-                                        while (l_proc == true && l_ptr < l_scr_len) {
-
-                                            if (l_ptr > vTerm.Screen_Cursor.X &&
-                                                vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr] == ' ' &&
-                                                vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr + 1] == ' ') {
-                                                l_proc = false;
-                                            }
-                                            else if (!isascii(vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr])) {
-                                                l_proc = false;
-                                            }
-                                            else {
-
-                                                l_alpha = true;
-
-                                                append_char(l_cmd, vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr], MAX_BUFFER_SIZE);
-
-                                                l_ptr = l_ptr + 1;
-
-                                            }
-                                        }
-
-                                        if (l_alpha == true) {
-
-                                            vTermSessionSetValue(trim(l_cmd), vTerm_Expected_Command_Prompt_pos, vTerm.Command_Seq);
-                                            vTermSessionSetValue(dupprintf("%d,%d", vTerm.Screen_Cursor.Y, l_scr_pos + 1), vTerm_Expected_Command_Prompt_At_pos, vTerm.Command_Seq);
-                                            vTermSessionSetValue(dupprintf("%d,%d", vTerm.Screen_Cursor.Y, l_scr_pos + 1), vTerm_Command_Prompt_At_pos, vTerm.Command_Seq);
-
-                                            strcpy(vTerm.Command_Prompt_Expected, vTermGetCommand(vTerm_Expected_Command_Prompt_pos, false));
-                                            strcpy(vTerm.Command_Prompt_Expected_Pos, vTermGetCommand(vTerm_Expected_Command_Prompt_At_pos, false));
-
-                                            strcpy(vTerm.Command_Prompt, vTerm.Command_Prompt_Expected);
-                                            strcpy(vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
-
-                                            l_alpha = false;
-
-                                        }
-
-                                        vTermSessionSetValue(vTerm.Command_Sent_Cursor_Pos, vTerm_Expected_Input_Cursor_At_pos, vTerm.Command_Seq);
-
-                                        l_proc = false;
-
-                                    }
-                                    else if (isascii(vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap][l_ptr])) {
-                                        l_alpha = true;
-                                    }
-
-                                    l_ptr = l_ptr - 1;
-
-                                }
-
-                                if (l_alpha == true) {
-
-                                    vTermSessionSetValue(rtrim(mid(vTerm.Screen_Array[vTerm.Screen_Cursor.Y - l_wrap], l_ptr, vTerm.Screen_Cursor.X - 1)), vTerm_Expected_Command_Prompt_pos, vTerm.Command_Seq);
-                                    vTermSessionSetValue(dupprintf("%d,%d", vTerm.Screen_Cursor.Y, l_ptr), vTerm_Expected_Command_Prompt_At_pos, vTerm.Command_Seq);
-                                    vTermSessionSetValue(dupprintf("%d,%d", vTerm.Screen_Cursor.Y, l_ptr), vTerm_Command_Prompt_At_pos, vTerm.Command_Seq);
-
-                                    strcpy(vTerm.Command_Prompt_Expected, vTermGetCommand(vTerm_Expected_Command_Prompt_pos, false));
-                                    strcpy(vTerm.Command_Prompt_Expected_Pos, vTermGetCommand(vTerm_Expected_Command_Prompt_At_pos, false));
-
-                                    strcpy(vTerm.Command_Prompt, vTerm.Command_Prompt_Expected);
-                                    strcpy(vTerm.Command_Prompt_Pos, vTerm.Command_Prompt_Expected_Pos);
-                                }
-
-                                vTermSessionSetValue(vTerm.Command_Sent_Cursor_Pos, vTerm_Expected_Input_Cursor_At_pos, vTerm.Command_Seq);
-                            }
-                        }
-                    }
-
-                    l_command = true;
-
-                    append_char(vTerm.Command_Processed, PuttyData[l_pos], MAX_BUFFER_SIZE);
-
-                    vTerm.Command_Processed_Len = strlen(vTerm.Command_Processed);
-
-                    if (vTerm.Command_Processing_Started == true) {
-                        append_string(vTerm.Command_Processed_ASCII, dupprintf("%d", ','), MAX_BUFFER_SIZE);
-                    }
-                    else {
-                        append_string(vTerm.Command_Processed_ASCII, dupprintf("%d", PuttyData[l_pos]), MAX_BUFFER_SIZE);
-                    }
-
-                    vTerm.Command_Processing_Started = true;
+    if (CommandType == vTerm_Command && DataLength > 0) {
 
-                    vTerm.Command_Processed_Logging = true;
+        vTermInputFeed(PuttyData, DataLength);
 
-                    l_proc = false;
-
-                    l_submit = false;
-
-                    if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
-                        l_proc = true;
-                    }
-                    else if (vTerm.Command_Sent_Len + vTerm.Submit_Key_Len <= 0) {
-                        l_proc = true;
-                    }
-                    else if (vTerm.Submit_Key_Len <= 0 && strcmp(vTerm.Command_Processed, vTerm.Command_Sent) == 0) {
-                        l_proc = true;
-                    }
-                    else if (vTerm.Submit_Key_Len > 0) {
-
-                        if (l_pos >= vTerm.Submit_Key_Len - 1) {
-
-                            if (strcmp(&PuttyData[l_pos - vTerm.Submit_Key_Len + 1], vTerm.Submit_Key_ANSI) == 0) {
-
-                                l_proc = true;
-
-                                l_submit = true;
-                            }
-                        }
-                        else if (strcmp(vTerm.Command_Processed, vTerm.Submit_Key_ANSI) == 0) {
-
-                            l_proc = true;
-
-                            l_submit = true;
-                        }
-                    }
-
-                    if (l_proc == true) {
-
-                        l_proc = false;
-
-                        if (l_submit == true || vTerm.Command_Seq > vTerm.Command_Seq_Max) {
-                            l_proc = true;
-                        }
-                        else if (vTerm.Command_Sent_Len > 0 && strcmp(vTerm.Command_Processed, vTerm.Command_Sent) == 0) {
-
-                            if (!(vTerm.Screen_Cursor_Prev_X == vTerm.Screen_Cursor.X - vTerm.Command_Send_Buffer_Len && vTerm.Screen_Cursor_Prev_Y == vTerm.Screen_Cursor.Y)) {
-                                l_proc = true;
-                            }
-                        }
-                        else if ((vTerm.Command_Sent_Len <= 0 && l_pos >= DataLength - 1) && (vTerm.Command_Processing == true)) {
-                            l_proc = true;
-                        }
-
-                        if (l_proc == true) {
-
-                            strcpy(l_cmd, vTerm.Command_Processed);
-
-                            l_cmd_len = vTerm.Command_Processed_Len;
-
-                            l_ptr = -1;
-
-                            char* pch;
-                            
-                            pch = strrchr(l_cmd, 0x1B);
-
-                            if (pch) l_ptr = pch - l_cmd;
-
-                            if (l_ptr >= 0) {
-
-                                if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
-
-                                    vTermSubmitKey(&PuttyData[l_pos], true);
-
-                                    l_cmd_len = DataLength;
-
-                                    l_pos = DataLength - 1;
-                                }
-                                else {
-                                    vTermSubmitKey(&l_cmd[l_ptr], true);
-                                }
-                            }
-                            else {
-                                vTermSubmitKey(&PuttyData[l_pos], true);
-                            }
-
-                            vTermSessionSetValue(vTerm.Command_Processed_ASCII, vTerm_Command_Processed_ASCII_pos, vTerm.Command_Seq);
-
-                            if (vTerm.Command_Submit_Key == true) {
-
-                                l_cmd_len = strlen(l_cmd) - vTerm.Command_Processed_Submit_Key_Len;
-
-                                memset(vTerm.Command_Processed, 0, MAX_BUFFER_SIZE);
-
-                                if (l_cmd_len > 0) {
-                                    strncpy(vTerm.Command_Processed, l_cmd, l_cmd_len);
-                                }
-
-                                vTermSessionSetValue(vTerm.Command_Processed_Submit_Key, vTerm_Command_Processed_Submit_Key_pos, vTerm.Command_Seq);
-
-                                if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
-                                    vTermSessionSetValue(vTerm.Command_Processed_Submit_Key, vTerm_Command_Submit_Key_pos, vTerm.Command_Seq);
-                                }
-
-                                l_submit_key = true;
-                            }
-                            else if (vTerm.Submit_Key_Len <= 0 && vTerm.Command_Processed_Len == vTerm.Command_Send_Len) {
-                                l_submit_key = true;
-                            }
-
-                            if (l_submit_key == true || vTerm.Command_Seq > vTerm.Command_Seq_Max) {
-
-                                vTermSessionSetValue(vTerm.Command_Processed, vTerm_Command_Processed_pos, vTerm.Command_Seq);
-
-                                if (l_submit_key == true) {
-                                    vTermSetCommandProcessed();
-                                }
-                                else if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
-                                    vTermSessionSetValue(vTerm.Command_Processed, vTerm_Command_Send_pos, vTerm.Command_Seq);
-                                }
-                            }
-
-                            if (vTerm.Command_Seq <= vTerm.Command_Seq_Max) {
-
-                                vTerm.Command_Processed_Manual_Input[0] = '\0';
-
-                                vTerm.Command_Processed_Len = 0;
-                                vTerm.Command_Processing_Started = false;
-                                vTerm.Command_Processing_Finished = true;
-                            }
-
-                            vTerm.Command_Send_Buffer_Len = 0;
-                            vTerm.Command_Send_Pos = 0;
+        vTermInputFlush();
+    }
+    else if (DataLength > 0) {
 
-                            vTerm.Submit_Key_Len = 0;
+        for (l_pos = 0; l_pos < DataLength; l_pos++) {
 
-                            vTerm.Command_Sent[0] = '\0';
+            if (PuttyData[l_pos] > 0) {
 
-                            vTerm.Command_Sent_Len = 0;
-                            vTerm.Command_Processing = false;
-                        }
-                    }
-                }
-                else if (CommandType == vTerm_Data) {
+                if (CommandType == vTerm_Data) {
 
                     if (CaptureScreensData == true) {
 
@@ -2925,6 +6889,14 @@ void vTermProcessData(char* PuttyData, int DataLength, int CommandType) {
         }
 
         if (CommandType == vTerm_Data && vTerm.Command_Processing == true) {
+
+            /* The echo is already in, so go on from the live cursor rather than waiting for the next screen read. */
+            if (vTermEchoComplete() == true && vTerm.Term != NULL) {
+
+                vTerm.Screen_Cursor.X = vTerm.Term->curs.x;
+                vTerm.Screen_Cursor.Y = vTerm.Term->curs.y;
+            }
+
             vTermSendCommand();
         }
     }
@@ -2934,6 +6906,30 @@ void vTermProcessData(char* PuttyData, int DataLength, int CommandType) {
     }
 }
 
+/* A jump back to Command_Seq starts a new pass: what the last pass processed is written out, and the screen ranges start again at the target. */
+void vTermCommandRestart(int Command_Seq) {
+
+    if (vTermLog_Execution == true) {
+        vTermWriteToLog("vTermCommandRestart|", dupprintf("%d", Command_Seq), dupprintf("%d", vTerm.Command_Pass + 1));
+    }
+
+    if (vTerm.Screen_Command_Seq_From <= vTerm.Screen_Command_Seq_To) {
+        vTermWriteSessionToFile();
+    }
+
+    vTerm.Commands_Input[0] = '\0';
+    vTerm.Commands_Processed[0] = '\0';
+
+    vTerm.Command_Pass++;
+
+    vTerm.Screen_Command_Seq_From = Command_Seq;
+    vTerm.Screen_Command_Seq_To = Command_Seq - 1;
+    vTerm.Screen_Capture_Command_Seq_From = Command_Seq;
+
+    /* So a mismatch or timeout on the new pass still re-reads the screen once first. */
+    vTerm.Screen_Requested_Seq = Command_Seq - 1;
+}
+
 void vTermNextScreenRow(bool Screen_Changed) {
 
     if (vTermLog_Execution == true) {
@@ -2975,6 +6971,8 @@ void vTermNextScreenRow(bool Screen_Changed) {
 
 void vTermScreenUpdated( char* PuttyData, int DataLength) {
 
+    int l_len;
+    int l_next;
     int l_pos;
     int l_ptr;
     int l_ptr2;
@@ -2998,12 +6996,13 @@ void vTermScreenUpdated( char* PuttyData, int DataLength) {
 
         vTerm.Command_Mismatch = false;
 
-        memset(vTerm.Screen_New, 0, sizeof(vTerm.Screen_New));
+        vTermScreenNewSize(DataLength);
 
-        strncpy(vTerm.Screen_New, PuttyData, DataLength);
+        memcpy(vTerm.Screen_New, PuttyData, DataLength);
 
         vTerm.Screen_New[DataLength] = '\0';
         vTerm.Screen_New_Len = strlen(vTerm.Screen_New);
+        vTerm.Screen_New_Rows = vTerm.Screen_New_Array_Rows;
 
         if (vTerm.Screen_New_Len <= 0) return;
 
@@ -3019,23 +7018,27 @@ void vTermScreenUpdated( char* PuttyData, int DataLength) {
         else if (!(vTerm.Command_Screen_Identifier_Len > 0 && strstr(vTerm.Screen_New, vTerm.Command_Screen_Identifier) != NULL) ||
                  !(vTerm.Command_Prompt_Len > 0 && strstr(vTerm.Screen_New, vTerm.Command_Prompt) != NULL)) {
 
-            l_ptr = string_split((char*)vTerm.Screen_New, '\n', MAX_SCREEN_ROWS, MAX_SCREEN_COLS, false);
-
-            vTerm.Screen_New_Rows = l_ptr;
+            /* .Screen_New_Array already holds the screen rows, updated by 'vTermScreenRead'. */
+            l_ptr = vTerm.Screen_New_Rows;
 
             if (vTerm.Screen_Array_Rows > 0 && vTerm.Screen_New_Rows > 0) {
 
                 if (l_ptr > 0) {
 
-                    l_rows[0] = MAX_BUFFER_SIZE - 1;
+                    l_rows[0] = vTerm.Screen_Array_Rows - 1;
 
-                    l_ptr = l_rows[0];
+                    /* Rows past .Screen_Array_Last are blank. */
+                    l_ptr = (vTerm.Screen_Array_Last < l_rows[0] ? vTerm.Screen_Array_Last : l_rows[0]);
                     l_proc = false;
 
+                    if (l_ptr < 0) {
+                        l_ptr = 0;
+                    }
+
                     /* Last populated row of .Screen_Array. */
                     while (l_ptr > 0 && l_proc == false) {
 
-                        if (strlen(trim(vTerm.Screen_Array[l_ptr])) > 1) {
+                        if (vTermScreenRowTrimLen(&vTerm.Screen_Array_Info[l_ptr]) > 1) {
                             l_proc = true;
                         }
                         else {
@@ -3045,7 +7048,8 @@ void vTermScreenUpdated( char* PuttyData, int DataLength) {
 
                     l_rows[1] = MAX_SCREEN_ROWS - 1;
 
-                    l_ptr2 = l_rows[1];
+                    /* Rows past .Screen_New_Array_Last are blank. */
+                    l_ptr2 = (vTerm.Screen_New_Array_Last > 1 ? vTerm.Screen_New_Array_Last : 1);
 
                     l_proc = false;
 
@@ -3057,10 +7061,10 @@ void vTermScreenUpdated( char* PuttyData, int DataLength) {
                     }
                     else {
 
-                        /* Latest populated row of String_Array. */
+                        /* Latest populated row of .Screen_New_Array. */
                         while (l_ptr2 > 0 && l_proc == false) {
 
-                            if (strlen(trim(String_Array[l_ptr2])) > 1) {
+                            if (vTermScreenRowTrimLen(&vTerm.Screen_New_Array_Info[l_ptr2]) > 1) {
                                 l_proc = true;
                             }
                             else {
@@ -3071,7 +7075,7 @@ void vTermScreenUpdated( char* PuttyData, int DataLength) {
                         /* Find start of overlapping content, working backwards from latest rows in both arrays. */
                         while (l_ptr >= 0 && l_ptr2 >= 0 && l_proc == true) {
 
-                            if (strlen(trim(vTerm.Screen_Array[l_ptr])) > 1 && strstr(String_Array[l_ptr2], vTerm.Screen_Array[l_ptr]) != NULL) {
+                            if (vTermScreenRowTrimLen(&vTerm.Screen_Array_Info[l_ptr]) > 1 && vTermScreenRowContains(l_ptr2, l_ptr)) {
                                 /* Found overlapping row. */
                                 l_proc = false;
                             }
@@ -3080,15 +7084,15 @@ void vTermScreenUpdated( char* PuttyData, int DataLength) {
                             }
                         }
 
-                        /* Find first rows where content does not match. */
+                        /* Find first rows where content does not match (mostly row hash compares, as the rows have just scrolled). */
                         while (l_ptr >= 0 && l_ptr2 >= 0 && l_proc == false) {
 
-                            if (strlen(trim(vTerm.Screen_Array[l_ptr])) > 0 && strstr(String_Array[l_ptr2], vTerm.Screen_Array[l_ptr]) == NULL) {
+                            if (vTermScreenRowTrimLen(&vTerm.Screen_Array_Info[l_ptr]) > 0 && !vTermScreenRowContains(l_ptr2, l_ptr)) {
 
                                 if (l_ptr2 <= 0) {
                                     l_proc = true;
                                 }
-                                else if (strcmp(String_Array[l_ptr2], String_Array[l_ptr2 - 1]) == 0) {
+                                else if (vTerm.Screen_New_Array_Info[l_ptr2].Len == vTerm.Screen_New_Array_Info[l_ptr2 - 1].Len && vTerm.Screen_New_Array_Info[l_ptr2].Hash == vTerm.Screen_New_Array_Info[l_ptr2 - 1].Hash) {
                                     l_ptr = l_ptr + 1;
                                 }
                                 else {
@@ -3140,7 +7144,17 @@ void vTermScreenUpdated( char* PuttyData, int DataLength) {
             vTerm.Submit_Key[0] = '\0';
             vTerm.Command_Processed[0] = '\0';
 
-            vTerm.Command_Seq = vTerm.Command_Seq + 1;
+            vTermEchoReset();
+
+            vTerm.Input_Len = 0;
+
+            l_next = vTermCommandNext(vTerm.Command_Seq);
+
+            if (l_next <= vTerm.Command_Seq) {
+                vTermCommandRestart(l_next);
+            }
+
+            vTerm.Command_Seq = l_next;
 
             if ((vTerm.Command_Seq > 1) && (vTerm.Command_Seq == vTerm.Command_Seq_Max + 1)) {
 
@@ -3151,7 +7165,7 @@ void vTermScreenUpdated( char* PuttyData, int DataLength) {
 
             l_new = true;
 
-            vTerm.Row_Updated_At = time(NULL);
+            vTerm.Row_Updated_At = GETTICKCOUNT();
 
             vTerm.Screen_Get = false;
 
@@ -3164,25 +7178,19 @@ void vTermScreenUpdated( char* PuttyData, int DataLength) {
 
             vTermNextScreenRow(true);
 
-            memset(vTerm.Screen, 0, sizeof(vTerm.Screen));
-
-            strcpy(vTerm.Screen, vTerm.Screen_New);
+            vTermScreenSwap();
         }
 
         else if (vTerm.Command_Seq > vTerm.Command_Seq_Max) {
 
-            memset(vTerm.Screen, 0, sizeof(vTerm.Screen));
-
-            strcpy(vTerm.Screen, vTerm.Screen_New);
+            vTermScreenSwap();
 
             l_proc = true;
         }
 
         else if (l_rows[0] < 0 || l_rows[1] < 0) {
 
-            memset(vTerm.Screen, 0, sizeof(vTerm.Screen));
-
-            strcpy(vTerm.Screen, vTerm.Screen_New);
+            vTermScreenSwap();
 
             l_proc = true;
         }
@@ -3202,7 +7210,7 @@ void vTermScreenUpdated( char* PuttyData, int DataLength) {
                     l_pos = l_rows[0] + 99;
                 }
 
-                else if (strlen(trim(vTerm.Screen_Array[l_pos])) > 1 && strstr(String_Array[l_pos], vTerm.Screen_Array[l_pos]) == NULL) {
+                else if (vTermScreenRowTrimLen(&vTerm.Screen_Array_Info[l_pos]) > 1 && !vTermScreenRowContains(l_pos, l_pos)) {
                     l_proc = false;
                 }
 
@@ -3211,27 +7219,40 @@ void vTermScreenUpdated( char* PuttyData, int DataLength) {
 
             if (l_proc == true) {
 
-                memset(vTerm.Screen, 0, sizeof(vTerm.Screen));
+                vTermScreenSwap();
+            }
 
-                strcpy(vTerm.Screen, vTerm.Screen_New);
+            else if (vTermScrollbackScreen()) {
+                /* The lines that scrolled off were kept as they left the screen. */
             }
 
             else {
 
-                memset(vTerm.Screen, 0, sizeof(vTerm.Screen));
+                /* Previous rows (each plus new line) followed by the new screen. */
+                vTermScreenUnshare(false);
+
+                l_len = vTerm.Screen_New_Len + 1;
+
+                for (l_ptr = 0; l_ptr <= l_pos - 1; l_ptr++) {
+                    l_len = l_len + vTerm.Screen_Array_Info[l_ptr].Len + 1;
+                }
+
+                sgrowarray(vTerm.Screen, vTerm.Screen_Size, l_len);
 
                 vTerm.Screen[0] = '\0';
 
                 for (l_ptr = 0; l_ptr <= l_pos - 1; l_ptr++) {
 
-                    for (l_ptr2 = 0; l_ptr2 < strlen(vTerm.Screen_Array[l_ptr]); l_ptr2++) {
-                        append_char(vTerm.Screen, vTerm.Screen_Array[l_ptr][l_ptr2], MAX_SCREEN_ROWS * MAX_SCREEN_COLS);
+                    for (l_ptr2 = 0; l_ptr2 < vTerm.Screen_Array_Info[l_ptr].Len; l_ptr2++) {
+                        append_char(vTerm.Screen, vTerm.Screen_Array[l_ptr][l_ptr2], (int)vTerm.Screen_Size);
                     }
 
-                    append_char(vTerm.Screen, '\n', MAX_BUFFER_SIZE);
+                    append_char(vTerm.Screen, '\n', (int)vTerm.Screen_Size);
                 }
 
-                append_string(vTerm.Screen, vTerm.Screen_New, MAX_BUFFER_SIZE);
+                append_string(vTerm.Screen, vTerm.Screen_New, (int)vTerm.Screen_Size);
+
+                vTerm.Screen_Gen++;
             }
         }
 
@@ -3239,9 +7260,7 @@ void vTermScreenUpdated( char* PuttyData, int DataLength) {
 
             vTerm.Screen_Len = vTerm.Screen_New_Len;
 
-            memcpy(vTerm.Screen_Array, String_Array, sizeof(String_Array));
-
-            vTerm.Screen_Array_Rows = vTerm.Screen_New_Rows;
+            vTermScreenArrayUpdate();
 
             vTermSessionSetValue(vTerm.Screen, vTerm_Screen_pos, vTerm.Command_Seq);
             vTermSessionSetValue(vTerm.Screen_Command_Seq_From, vTerm_Screen_Command_Seq_pos, vTerm.Command_Seq);
@@ -3267,7 +7286,9 @@ void vTermScreenUpdated( char* PuttyData, int DataLength) {
     }
 }
 
-void vTermInitialise(long term_hwnd) {
+void vTermInitialise(long term_hwnd, Terminal* term) {
+
+    char* image;
 
     int pos = -1;
 
@@ -3279,21 +7300,44 @@ void vTermInitialise(long term_hwnd) {
 
     RecordForScripting = false;
 
-    SessionsKeyPressSync = true;
+    SessionsKeyPressSync = (vterm_send_batch != true);
+
+    vTermEchoVerified = 0;
 
     vTermLog_Execution = false;   // For debugging only.
 
+    vTerm.Term = term;
+
     pos = instr(vterm_hostname, "@", 0);
 
     if (pos >= 0) {
         strcpy(vterm_hostname, mid(dupstr(vterm_hostname), pos + 1, strlen(vterm_hostname)));
     }
     
-    ReadKeyCodesFromFile();
+    vTermScriptFilesResolve();
+
+    image = vTermImageLoad();
+
+    if (image == NULL) {
+
+        ReadKeyCodesFromFile();
+
+        vTermKeyCodesIndex();
+    }
 
     vTermSessionInitialise(vterm_sessionid);
 
-    ReadCommandsFromFile();
+    if (image == NULL) {
+
+        ReadCommandsFromFile();
+
+        vTermImageSave();
+    }
+    else {
+        vTermImageCommands(image);
+    }
+
+    vTermDatasetOpen();
 
     vTerm.Command_Seq = 1;
 
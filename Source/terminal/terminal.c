@@ -104,6 +104,40 @@ static void term_added_data(Terminal *term, bool);
 static void term_update_raw_mouse_mode(Terminal *term);
 static void term_out_cb(void *);
 
+/* PuttyDriver #17 - Keep a generation count per screen row, so the driver only re-reads rows that have changed. */
+#ifdef PuttyDriver
+static void vterm_rows_changed(Terminal *term, int top, int bottom)
+{
+    size_t oldsize = vterm_row_gen_size;
+    int y;
+
+    if (putty_driver != true || term->rows <= 0)
+        return;
+
+    sgrowarray(vterm_row_gen, vterm_row_gen_size, term->rows);
+    if (vterm_row_gen_size > oldsize)
+        memset(vterm_row_gen + oldsize, 0,
+               (vterm_row_gen_size - oldsize) * sizeof(*vterm_row_gen));
+
+    vterm_screen_gen++;
+
+    if (top < 0)
+        top = 0;
+    if (bottom >= term->rows)
+        bottom = term->rows - 1;
+
+    for (y = top; y <= bottom; y++)
+        vterm_row_gen[y] = vterm_screen_gen;
+}
+#endif
+/* PuttyDriver */
+
+/* PuttyDriver #18 - Hand lines scrolling off the top of the screen to the driver, so none are missed between screen reads. */
+#ifdef PuttyDriver
+void vTermScrollbackAdd(Terminal *term, termline *ldata);
+#endif
+/* PuttyDriver */
+
 static termline *newtermline(Terminal *term, int cols, bool bce)
 {
     termline *line;
@@ -2353,6 +2387,12 @@ void term_size(Terminal *term, int newrows, int newcols, int newsavelines)
     term->cols = newcols;
     term->savelines = newsavelines;
 
+/* PuttyDriver #17 - Row changed. */
+#ifdef PuttyDriver
+    vterm_rows_changed(term, 0, term->rows - 1);
+#endif
+/* PuttyDriver */
+
     swap_screen(term, save_alt_which, false, false);
 
     term->win_scrollbar_update_pending = true;
@@ -2438,6 +2478,13 @@ static void swap_screen(Terminal *term, int which,
         ttr = term->alt_screen;
         term->alt_screen = term->screen;
         term->screen = ttr;
+
+/* PuttyDriver #17 - Row changed. */
+#ifdef PuttyDriver
+        vterm_rows_changed(term, 0, term->rows - 1);
+#endif
+/* PuttyDriver */
+
         term->alt_sblines = (
             term->alt_screen ?
             find_last_nonempty_line(term, term->alt_screen) + 1 : 0);
@@ -2632,6 +2679,14 @@ static void scroll(Terminal *term, int topline, int botline,
 #ifdef TERM_CC_DIAGS
             cc_check(line);
 #endif
+
+/* PuttyDriver #18 - Line scrolled off. */
+#ifdef PuttyDriver
+            if (sb && putty_driver == true)
+                vTermScrollbackAdd(term, line);
+#endif
+/* PuttyDriver */
+
             if (sb && term->savelines > 0) {
                 int sblen = count234(term->scrollback);
                 /*
@@ -2721,6 +2776,12 @@ static void scroll(Terminal *term, int topline, int botline,
         }
     }
 
+/* PuttyDriver #17 - Row changed. */
+#ifdef PuttyDriver
+    vterm_rows_changed(term, topline, botline);
+#endif
+/* PuttyDriver */
+
     seen_disp_event(term);
 }
 
@@ -2950,6 +3011,12 @@ static void erase_lots(Terminal *term,
     if (erasing_lines_from_top && !(term->alt_which))
         term->tempsblines = 0;
 
+/* PuttyDriver #17 - Row changed. */
+#ifdef PuttyDriver
+    vterm_rows_changed(term, start.y, end.y);
+#endif
+/* PuttyDriver */
+
     seen_disp_event(term);
 }
 
@@ -3026,6 +3093,12 @@ static void insch(Terminal *term, int n)
         while (n--)
             copy_termchar(ldata, term->curs.x + n, &term->erase_char);
     }
+
+/* PuttyDriver #17 - Row changed. */
+#ifdef PuttyDriver
+    vterm_rows_changed(term, term->curs.y, term->curs.y);
+#endif
+/* PuttyDriver */
 }
 
 static void term_update_raw_mouse_mode(Terminal *term)
@@ -3298,6 +3371,12 @@ static void term_display_graphic_char(Terminal *term, unsigned long c)
     if (!width)
         width = term_char_width(term, c);
 
+/* PuttyDriver #17 - Row changed. */
+#ifdef PuttyDriver
+    vterm_rows_changed(term, term->curs.y, term->curs.y);
+#endif
+/* PuttyDriver */
+
     if (term->wrapnext && term->wrap && width > 0) {
         cline->lattr |= LATTR_WRAPPED;
         if (term->curs.y == term->marg_b)
@@ -3432,6 +3511,13 @@ static void term_display_graphic_char(Terminal *term, unsigned long c)
       default:
         return;
     }
+
+/* PuttyDriver #17 - Row changed. */
+#ifdef PuttyDriver
+    vterm_rows_changed(term, term->curs.y, term->curs.y);
+#endif
+/* PuttyDriver */
+
     term->curs.x++;
     if (term->curs.x >= linecols) {
         term->curs.x = linecols - 1;
@@ -3867,6 +3953,12 @@ static void term_out(Terminal *term, bool called_from_term_data)
                 check_boundary(term, term->curs.x+1, term->curs.y);
                 copy_termchar(scrlineptr(term->curs.y),
                               term->curs.x, &term->erase_char);
+
+/* PuttyDriver #17 - Row changed. */
+#ifdef PuttyDriver
+                vterm_rows_changed(term, term->curs.y, term->curs.y);
+#endif
+/* PuttyDriver */
             }
             seen_disp_event(term);
         } else
@@ -4230,6 +4322,13 @@ static void term_out(Terminal *term, bool called_from_term_data)
                     }
                     if (term->scroll_on_disp)
                         term->disptop = 0;
+
+/* PuttyDriver #17 - Row changed. */
+#ifdef PuttyDriver
+                    vterm_rows_changed(term, 0, term->rows - 1);
+#endif
+/* PuttyDriver */
+
                     seen_disp_event(term);
                     scrtop.x = scrtop.y = 0;
                     scrbot.x = 0;
@@ -5057,6 +5156,13 @@ static void term_out(Terminal *term, bool called_from_term_data)
                         while (n--)
                             copy_termchar(cline, p++,
                                           &term->erase_char);
+
+/* PuttyDriver #17 - Row changed. */
+#ifdef PuttyDriver
+                        vterm_rows_changed(term, term->curs.y, term->curs.y);
+#endif
+/* PuttyDriver */
+
                         seen_disp_event(term);
                         break;
                       }
@@ -5754,6 +5860,9 @@ static void term_out(Terminal *term, bool called_from_term_data)
 
             char buf[30];
 
+            /* Only the event is raised here; PuttyDriver #13 runs vTermEvent for it once PuTTY is idle. */
+            vterm_events |= vTerm_Event_Cursor;
+
             sprintf(buf, "#~#CUR2%04d %04d %04d %04d#~#", term->curs.x, term->curs.y, term->cols, term->rows);
 
             if (parent_hwnd > 0) {
@@ -5771,21 +5880,6 @@ static void term_out(Terminal *term, bool called_from_term_data)
                     SendMessage(parent_hwnd, WM_COPYDATA, (WPARAM)putty_hwnd, (LPARAM)&cd);
                 }
             }
-            else {
-
-                strncpy(vterm_message, buf, strlen(buf));
-
-                if (vTermLog_Execution == true) {
-                        vTermWriteToLog("PuTTY term_out->vTermWaitingForInput - Before", vterm_message, "");
-                }
-
-                vTermWaitingForInput(term->curs.x, term->curs.y, term->cols, term->rows, true);
-
-                if (vTermLog_Execution == true) {
-                    vTermWriteToLog("PuTTY term_out->vTermWaitingForInput - After", vterm_message, "");
-                }
-
-            }
 
             vterm_curs_x = term->curs.x;
             vterm_curs_y = term->curs.y;
@@ -6878,49 +6972,28 @@ static void clipme(Terminal *term, pos top, pos bottom, bool rect, bool desel,
         int i;
         bool clip_local = false;
 
-/* PuttyDriver #8 - Capture Putty screen via clipboard. */
+/* PuttyDriver #8 - Capture Putty screen via clipboard (parent APP only). */
 #ifdef PuttyDriver
 
-        if (putty_driver == true && vterm_started == true) {
+        if (putty_driver == true && vterm_started == true && parent_hwnd > 0) {
 
-           int buflen = WideCharToMultiByte(CP_ACP, 0, buf.textbuf, buf.bufpos, 0, 0, NULL, NULL);
+           int buflen = WideCharToMultiByte(CP_UTF8, 0, buf.textbuf, buf.bufpos, 0, 0, NULL, NULL);
 
            char* mdat = (char*)malloc(buflen);
                 
-           WideCharToMultiByte(CP_ACP, 0, buf.textbuf, buf.bufpos, mdat, buflen, NULL, NULL);
-                
-            if (parent_hwnd > 0) {
-
-                HWND parent = GetWindow(parent_hwnd, GW_HWNDFIRST);
-
-                if (parent > 0) {
-
-                    COPYDATASTRUCT cd;
-
-                    cd.dwData = 6;
-                    cd.cbData = buflen;
-                    cd.lpData = (VOID *) mdat;
+           WideCharToMultiByte(CP_UTF8, 0, buf.textbuf, buf.bufpos, mdat, buflen, NULL, NULL);
 
-                    SendMessage(parent_hwnd, WM_COPYDATA, (WPARAM)putty_hwnd, (LPARAM)&cd);
-                 }
-            }
-            else {
-
-                memset(vterm_message, 0, MAX_MESSAGE_LENGTH);
-
-                strncpy(vterm_message, mdat, buflen);
+            HWND parent = GetWindow(parent_hwnd, GW_HWNDFIRST);
 
-                vterm_message[buflen] = 0;
+            if (parent > 0) {
 
-                if (vTermLog_Execution == true) {   
-                    vTermWriteToLog("PuTTY void_clipme->vTermScreenUpdated - Before", dupprintf("%d", buflen), vterm_message);
-                }
+                COPYDATASTRUCT cd;
 
-                vTermScreenUpdated(vterm_message, buflen);
+                cd.dwData = 6;
+                cd.cbData = buflen;
+                cd.lpData = (VOID *) mdat;
 
-                if (vTermLog_Execution == true) {   
-                    vTermWriteToLog("PuTTY void_clipme->vTermScreenUpdated - After", dupprintf("%d", buflen), vterm_message);
-                }
+                SendMessage(parent_hwnd, WM_COPYDATA, (WPARAM)putty_hwnd, (LPARAM)&cd);
             }
 
             vterm_curs_x = term->curs.x;
@@ -8030,6 +8103,8 @@ size_t term_data(Terminal *term, const void *data, size_t len)
 #ifdef PuttyDriver
     if (putty_driver == true && vterm_started == true) {
 
+        vterm_events |= vTerm_Event_Data;
+
         if (parent_hwnd > 0) {
 
             HWND parent = GetWindow(parent_hwnd, GW_HWNDFIRST);
@@ -459,11 +459,23 @@ int WINAPI WinMain(HINSTANCE inst, HINSTANCE prev, LPSTR cmdline, int show)
 
     vterm_nocapture = false;
 
+    vterm_capture_delta = 0;
+
     vterm_screen_speed = -1;
+
+    vterm_screen_history = -1;
+
+    vterm_send_batch = false;
+
+    vterm_send_adaptive = false;
     
     vterm_started = false;
 
+    vterm_events = 0;
+
     memset(vterm_capture_file, 0, sizeof(vterm_capture_file));
+
+    memset(vterm_dataset_file, 0, sizeof(vterm_dataset_file));
 #endif	
 /* PuttyDriver */
 
@@ -827,7 +839,7 @@ int WINAPI WinMain(HINSTANCE inst, HINSTANCE prev, LPSTR cmdline, int show)
             vterm_curs_y = -1;
         }
         else {
-            vTermInitialise(wgs->term_hwnd);
+            vTermInitialise(wgs->term_hwnd, wgs->term);
         }
     }
 #endif
@@ -917,12 +929,16 @@ int WINAPI WinMain(HINSTANCE inst, HINSTANCE prev, LPSTR cmdline, int show)
 
         run_toplevel_callbacks();
 
-/* PuttyDriver #13 - Putty is waiting for some user input.  */
+/* PuttyDriver #13 - Putty is waiting for some user input; only after something happened, so an idle session does nothing.  */
 #ifdef PuttyDriver
-        if (putty_driver == true) {
+        if (putty_driver == true && (vterm_started != true || vterm_events != 0)) {
 
             char buf[30];
 
+            int events = (vterm_started == true ? vterm_events : vTerm_Event_Cursor);
+
+            vterm_events = 0;
+
             sprintf(buf, "#~#CUR3%04d %04d %04d %04d#~#", wgs->term->curs.x, wgs->term->curs.y, wgs->term->cols, wgs->term->rows);
 
             if (parent_hwnd > 0) {
@@ -954,13 +970,13 @@ int WINAPI WinMain(HINSTANCE inst, HINSTANCE prev, LPSTR cmdline, int show)
                 strncpy(vterm_message, buf, strlen(buf));
 
                 if (vTermLog_Execution == true) {
-                    vTermWriteToLog("PuTTY WinMain->vTermWaitingForInput - Before", vterm_message, "");
+                    vTermWriteToLog("PuTTY WinMain->vTermEvent - Before", vterm_message, "");
                 }
 
-                vTermWaitingForInput(wgs->term->curs.x, wgs->term->curs.y, wgs->term->cols, wgs->term->rows, false);
+                vTermEvent(events, wgs->term);
 
                 if (vTermLog_Execution == true) {
-                    vTermWriteToLog("PuTTY WinMain->vTermWaitingForInput - After", vterm_message, "");
+                    vTermWriteToLog("PuTTY WinMain->vTermEvent - After", vterm_message, "");
                 }
 
             }